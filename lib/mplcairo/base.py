@@ -1,13 +1,16 @@
+from collections import OrderedDict
 import codecs
 import contextlib
-from functools import partial, partialmethod
+from functools import lru_cache, partial, partialmethod
 from gzip import GzipFile
 import logging
 import os
 from pathlib import Path
 import shutil
+import sys
 from tempfile import TemporaryDirectory
-from threading import RLock
+from threading import Lock, RLock
+import weakref
 
 import numpy as np
 from PIL import Image
@@ -25,7 +28,10 @@ from ._mplcairo import _StreamSurfaceType
 
 
 _log = logging.getLogger()
-_LOCK = RLock()  # FreeType2 is thread-unsafe.
+# The font layer is thread-safe, and the GIL is released while cairo
+# rasterizes, so independent figures can be drawn concurrently.  This lock is
+# only kept as the renderer's "lock" attribute, which some GUI backends expect.
+_LOCK = RLock()
 
 
 class _BytesWritingWrapper:
@@ -38,17 +44,39 @@ class _BytesWritingWrapper:
         return self._stream.write(codecs.decode(data, self._encoding))
 
 
-def _get_drawn_subarray_and_bounds(img):
-    """Return the drawn region of a buffer and its ``(l, b, w, h)`` bounds."""
-    drawn = img[..., 3] != 0
-    x_nz, = drawn.any(axis=0).nonzero()
-    y_nz, = drawn.any(axis=1).nonzero()
-    if len(x_nz) and len(y_nz):
-        l, r = x_nz[[0, -1]]
-        b, t = y_nz[[0, -1]]
-        return img[b:t+1, l:r+1], (l, b, r - l + 1, t - b + 1)
-    else:
-        return np.zeros((0, 0, 4), dtype=np.uint8), (0, 0, 0, 0)
+@lru_cache(64)
+def _get_usetex_mathtext_backend(texmanager, s, fontsize, dpi, basefile):
+    """
+    Return a `MathtextBackendCairo` holding the laid out glyphs of a usetex
+    string.
+
+    The DVI file is parsed and the glyphs resolved only on cache misses;
+    *basefile* is only used as part of the cache key.
+    """
+    dvifile = texmanager.make_dvi(s, fontsize)
+    with dviread.Dvi(dvifile, dpi) as dvi:
+        page = next(iter(dvi))
+    specs = []
+    for text in page.text:
+        texfont = _util.get_tex_font_map()[text.font.texname]
+        if texfont.filename is None:
+            # Not TypeError:
+            # :mpltest:`test_backend_svg.test_missing_psfont`.
+            raise ValueError(f"No font file found for {texfont.psname} "
+                             f"({texfont.texname!a})")
+        specs.append((
+            text.x, -text.y,
+            texfont.filename, text.font.size,
+            _util.get_glyph_name(text) or text.glyph,
+            texfont.effects.get("slant", 0),
+            texfont.effects.get("extend", 1)))
+    mb = _mplcairo.MathtextBackendCairo()
+    if specs:
+        mb.add_usetex_glyphs(*zip(*specs))
+    mb.add_rects(np.array(
+        [(x1, -y1, x1 + w, -(y1 + h)) for x1, y1, h, w in page.boxes],
+        float).reshape((-1, 4)))
+    return mb
 
 
 class GraphicsContextRendererCairo(
@@ -64,6 +92,24 @@ class GraphicsContextRendererCairo(
             self, width, height, dpi)
         RendererBase.__init__(self)
 
+    @classmethod
+    def from_buffer(cls, buf, dpi):
+        """
+        Create a renderer drawing directly into *buf*.
+
+        *buf* must be a writable buffer (e.g. a NumPy array, or a
+        ``memoryview`` of a ``mmap``, cast to the right shape) of shape
+        ``(height, width, 4)``, with contiguous, 4-byte-aligned rows (the row
+        stride may be larger than the row size).  It holds premultiplied ARGB32
+        pixels if of uint8 type (i.e., BGRA bytes on little-endian systems), or
+        premultiplied RGBA128F pixels if of float32 type.  The buffer is
+        pinned and kept alive as long as the renderer is.
+        """
+        obj = _mplcairo.GraphicsContextRendererCairo.__new__(cls, buf, dpi)
+        _mplcairo.GraphicsContextRendererCairo.__init__(obj, buf, dpi)
+        RendererBase.__init__(obj)
+        return obj
+
     @classmethod
     def from_pycairo_ctx(cls, ctx, width, height, dpi, orig_scale):
         obj = _mplcairo.GraphicsContextRendererCairo.__new__(
@@ -104,12 +150,25 @@ class GraphicsContextRendererCairo(
         RendererBase.__init__(obj)
         return obj
 
+    @classmethod
+    def _for_tiled_output(cls, width, height, dpi):
+        # Records the drawing, to be replayed band by band by
+        # _write_tiled_png.
+        obj = _mplcairo.GraphicsContextRendererCairo.__new__(
+            cls, width, height, dpi, True)
+        _mplcairo.GraphicsContextRendererCairo.__init__(
+            obj, width, height, dpi, True)
+        RendererBase.__init__(obj)
+        return obj
+
     _for_pdf_output = partialmethod(_for_fmt_output, _StreamSurfaceType.PDF)
     _for_ps_output = partialmethod(_for_fmt_output, _StreamSurfaceType.PS)
     _for_eps_output = partialmethod(_for_fmt_output, _StreamSurfaceType.EPS)
     _for_svg_output = partialmethod(_for_fmt_output, _StreamSurfaceType.SVG)
     _for_script_output = partialmethod(
         _for_fmt_output, _StreamSurfaceType.Script)
+    _for_recording_output = partialmethod(
+        _for_fmt_output, _StreamSurfaceType.Recording)
 
     @classmethod
     def _for_svgz_output(cls, stream, width, height, dpi):
@@ -136,55 +195,58 @@ class GraphicsContextRendererCairo(
     # Based on the backend_pdf implementation.
     def draw_tex(self, gc, x, y, s, prop, angle, ismath="TeX!", mtext=None):
         fontsize = prop.get_size_in_points()
-        dvifile = self.get_texmanager().make_dvi(s, fontsize)
-        with dviread.Dvi(dvifile, self.dpi) as dvi:
-            page = next(iter(dvi))
-        mb = _mplcairo.MathtextBackendCairo()
-        for text in page.text:
-            texfont = _util.get_tex_font_map()[text.font.texname]
-            if texfont.filename is None:
-                # Not TypeError:
-                # :mpltest:`test_backend_svg.test_missing_psfont`.
-                raise ValueError(f"No font file found for {texfont.psname} "
-                                 f"({texfont.texname!a})")
-            mb.add_usetex_glyph(
-                text.x, -text.y,
-                texfont.filename, text.font.size,
-                _util.get_glyph_name(text) or text.glyph,
-                texfont.effects.get("slant", 0),
-                texfont.effects.get("extend", 1))
-        for x1, y1, h, w in page.boxes:
-            mb.add_rect(x1, -y1, x1 + w, -(y1 + h))
+        texmanager = self.get_texmanager()
+        # The basefile hash covers the preamble and font settings, so that
+        # changes to them invalidate the cache.
+        mb = _get_usetex_mathtext_backend(
+            texmanager, s, fontsize, self.dpi,
+            texmanager.get_basefile(s, fontsize))
         mb.draw(self, x, y, angle)
 
     def stop_filter(self, filter_func):
-        img = _mplcairo.cairo_to_straight_rgba8888(
-            self._stop_filter_get_buffer())
-        img, (l, b, w, h) = _get_drawn_subarray_and_bounds(img)
+        # The buffer only covers the group's drawn extents, at offset (x, y);
+        # only the drawn region thereof is converted.
+        buf, (x, y) = self._stop_filter_get_buffer()
+        img, (l, b, w, h) = _mplcairo._get_drawn_subarray_and_bounds(buf)
         if not (w and h):
             return
+        l += x
+        b += y
         img, dx, dy = filter_func(img[::-1] / 255, self.dpi)
         if img.dtype.kind == "f":
             img = np.asarray(img * 255, np.uint8)
         width, height = self.get_canvas_width_height()
         self.draw_image(self, l + dx, height - b - h + dy, img)
 
-    start_rasterizing = _mplcairo.GraphicsContextRendererCairo.start_filter
-    stop_rasterizing = partialmethod(stop_filter, lambda img, dpi: (img, 0, 0))
-
     # "Undocumented" APIs needed to patch Agg.
 
     lock = _LOCK  # For webagg_core; matplotlib#10708 (<3.0).
 
+    def _get_buffer(self):
+        # Always return the same view (the surface is still flushed), so that
+        # _RendererPool can tell from its refcount whether it escaped: views
+        # derived from it keep it alive as their base.
+        buf = super()._get_buffer()
+        if getattr(self, "_buffer_view", None) is None:
+            self._buffer_view = buf
+        return self._buffer_view
+
     def buffer_rgba(self):  # For tkagg, webagg_core.
-        return _mplcairo.cairo_to_straight_rgba8888(self._get_buffer())
+        # Like Agg's buffer_rgba, the returned array is overwritten by the next
+        # call (it is converted into a scratch buffer to avoid reallocating a
+        # full-size array for each frame).
+        buf = self._get_buffer()
+        scratch = getattr(self, "_rgba8888_scratch", None)
+        if scratch is None or scratch.shape != buf.shape:
+            scratch = self._rgba8888_scratch = np.empty(buf.shape, np.uint8)
+        return _mplcairo.cairo_to_straight_rgba8888(buf, out=scratch)
 
     _renderer = property(buffer_rgba)  # For tkagg; matplotlib#18993 (<3.4).
 
     # For MixedModeRenderer; matplotlib#17788 (<3.4).
     def tostring_rgba_minimized(self):
-        img, bounds = _get_drawn_subarray_and_bounds(
-            _mplcairo.cairo_to_straight_rgba8888(self._get_buffer()))
+        img, bounds = _mplcairo._get_drawn_subarray_and_bounds(
+            self._get_buffer())
         return img.tobytes(), bounds
 
 
@@ -195,12 +257,156 @@ def _check_print_extra_kwargs(*,
     pass
 
 
+class _RendererPool:
+    """
+    A process-wide pool of idle image renderers, keyed by size, dpi and surface
+    format, so that canvases (of any figure) can reuse each other's surfaces
+    instead of reallocating them.
+
+    The total size of the pooled surfaces is capped by the
+    ``renderer_pool_size`` option; the least recently returned renderers are
+    evicted first.
+
+    A pooled renderer gets redrawn for another figure, which would corrupt the
+    output of anyone still drawing to it (e.g., a caller of ``get_renderer()``
+    holding on to it for blitting, or ``Figure._cachedRenderer``), or reading
+    an array previously returned by its ``_get_buffer()`` or
+    ``buffer_rgba()``.  Thus, renderers are only handed out again once neither
+    they nor their buffers are referenced outside of the pool.
+    """
+
+    def __init__(self):
+        self._lock = Lock()
+        self._renderers = OrderedDict()  # (key, id) -> renderer, LRU first.
+        self._nbytes = 0
+
+    @staticmethod
+    def _nbytes_for(key):
+        width, height, dpi, float_surface = key
+        return width * height * (16 if float_surface else 4)
+
+    def get(self, width, height, dpi):
+        """Check out a renderer, reusing a pooled one if possible."""
+        key = (int(width), int(height), dpi,
+               _mplcairo.get_options()["float_surface"])
+        with self._lock:
+            for pool_key in reversed(list(self._renderers)):  # MRU first.
+                if pool_key[0] != key:
+                    continue
+                renderer = self._renderers[pool_key]
+                # Referenced by the pool, by renderer, and by getrefcount's
+                # argument (if the count is off, reuse is merely disabled).
+                if sys.getrefcount(renderer) != 3:
+                    continue  # Still in use; may be reused once released.
+                del self._renderers[pool_key]
+                self._nbytes -= self._nbytes_for(key)
+                # Buffers may have been fetched again after the check in.
+                if self._drop_buffers(renderer):
+                    return renderer
+        renderer = GraphicsContextRendererCairo(width, height, dpi)
+        renderer._pool_key = key
+        return renderer
+
+    @staticmethod
+    def _drop_buffers(renderer):
+        """
+        Drop the renderer's cached buffers; return whether they were not
+        referenced elsewhere.
+        """
+        unshared = True
+        for name in ["_buffer_view", "_rgba8888_scratch"]:
+            buf = vars(renderer).pop(name, None)
+            # Referenced by buf and by getrefcount's argument.
+            if buf is not None and sys.getrefcount(buf) != 2:
+                unshared = False
+        return unshared
+
+    def put(self, renderer):
+        """
+        Check a renderer back in.  It is only handed out again once it is not
+        referenced elsewhere anymore.
+        """
+        if not self._drop_buffers(renderer):
+            return
+        key = renderer._pool_key
+        nbytes = self._nbytes_for(key)
+        with self._lock:
+            max_nbytes = _mplcairo.get_options()["renderer_pool_size"]
+            if nbytes > max_nbytes:
+                return
+            self._renderers[key, id(renderer)] = renderer
+            self._nbytes += nbytes
+            while self._nbytes > max_nbytes:
+                (old_key, _), _ = self._renderers.popitem(last=False)
+                self._nbytes -= self._nbytes_for(old_key)
+
+
+_RENDERER_POOL = _RendererPool()
+
+
+# "filter" and "threads" are not Pillow kwargs, but select the native writer's
+# PNG filter and compression threads (Pillow ignores unknown kwargs).
+_NATIVE_PNG_KWARGS = {
+    "compress_level", "optimize", "dpi", "filter", "threads"}
+
+
+def _use_native_png(pil_kwargs):
+    return (hasattr(_mplcairo, "write_png")
+            and pil_kwargs.keys() <= _NATIVE_PNG_KWARGS)
+
+
+def _use_tiled_png(pil_kwargs, height):
+    return (_use_native_png(pil_kwargs)
+            and 0 < _mplcairo.get_options()["tile_height"] < height)
+
+
+def _save_png(renderer, path_or_stream, *,
+              tiled, dpi, metadata, pil_kwargs):
+    # *renderer* must be a tiled renderer if *tiled* is set (see
+    # _use_tiled_png), and *pil_kwargs* may be modified.
+    metadata = {
+        "Software":
+        f"matplotlib version {get_versions()['matplotlib']}, "
+        f"https://matplotlib.org",
+        **(metadata if metadata is not None else {}),
+    }
+    if _use_native_png(pil_kwargs):
+        compress_level = pil_kwargs.get(
+            "compress_level", 9 if pil_kwargs.get("optimize") else -1)
+        write_png = (
+            renderer._write_tiled_png if tiled else
+            partial(_mplcairo.write_png, renderer._get_buffer()))
+        with cbook.open_file_cm(path_or_stream, "wb") as stream:
+            write_png(
+                stream,
+                compress_level=compress_level,
+                filter=pil_kwargs.get("filter", "adaptive"),
+                metadata=metadata,
+                dpi=pil_kwargs.get("dpi", (dpi, dpi)),
+                threads=pil_kwargs.get("threads"))
+        return
+    pil_kwargs.pop("filter", None)
+    pil_kwargs.pop("threads", None)
+    img = renderer.buffer_rgba()
+    # Only use the metadata kwarg if pnginfo is not set, because the
+    # semantics of duplicate keys in pnginfo is unclear.
+    if "pnginfo" not in pil_kwargs:
+        pnginfo = PngInfo()
+        for k, v in metadata.items():
+            pnginfo.add_text(k, v)
+        pil_kwargs["pnginfo"] = pnginfo
+    pil_kwargs.setdefault("dpi", (dpi, dpi))
+    Image.fromarray(img).save(path_or_stream, format="png", **pil_kwargs)
+
+
 class FigureCanvasCairo(FigureCanvasBase):
     # Although this attribute should semantically be set from __init__ (it is
     # purely an instance attribute), initializing it at the class level helps
     # when patching FigureCanvasAgg (for gtk3agg) as the latter would fail to
     # initialize it.
     _last_renderer_call = None, None
+    _target_buffer = None
+    _renderer_checkout = None  # Returns the renderer to the pool when called.
 
     def __init__(self, *args, **kwargs):
         _util.fix_ipython_backend2gui()
@@ -217,20 +423,51 @@ class FigureCanvasCairo(FigureCanvasBase):
         last_call, last_renderer = self._last_renderer_call
         if args == last_call:
             renderer = last_renderer
+        elif self._target_buffer is not None:
+            self._check_in_renderer()
+            renderer = GraphicsContextRendererCairo.from_buffer(
+                self._target_buffer, self.figure.dpi)
+            if (renderer.width, renderer.height) != tuple(map(int, args[:2])):
+                raise ValueError(
+                    f"The target buffer has size {renderer.width}x"
+                    f"{renderer.height}, but the figure has size "
+                    f"{int(args[0])}x{int(args[1])}")
+            self._last_renderer_call = args, renderer
         else:
-            renderer = GraphicsContextRendererCairo(*args)
+            self._check_in_renderer()
+            renderer = _RENDERER_POOL.get(*args)
             self._last_renderer_call = args, renderer
+            # Also return the renderer to the pool when the canvas dies.
+            self._renderer_checkout = weakref.finalize(
+                self, _RENDERER_POOL.put, renderer)
         if cleared:  # matplotlib#22245 (<3.6).
             renderer.clear()
         return renderer
 
     renderer = property(get_renderer)  # NOTE: Needed for FigureCanvasAgg.
 
+    def _check_in_renderer(self):
+        if self._renderer_checkout is not None:
+            self._renderer_checkout()  # No-op if already called.
+            self._renderer_checkout = None
+        self._last_renderer_call = None, None
+
+    def set_target_buffer(self, buf):
+        """
+        Draw directly into *buf* (or into an internal buffer, if None).
+
+        *buf* must match the figure size in pixels; see
+        `GraphicsContextRendererCairo.from_buffer` for the supported buffers.
+        This avoids copying each frame when it is consumed in place (e.g., from
+        shared memory by another process).
+        """
+        self._target_buffer = buf
+        self._check_in_renderer()
+
     def draw(self):
         renderer = self.get_renderer()
         renderer.clear()
-        with _LOCK:
-            self.figure.draw(renderer)
+        self.figure.draw(renderer)
         super().draw()
 
     def buffer_rgba(self):  # NOTE: Needed for tests.
@@ -240,8 +477,7 @@ class FigureCanvasCairo(FigureCanvasBase):
         return self.get_renderer().copy_from_bbox(bbox)
 
     def restore_region(self, region):
-        with _LOCK:
-            self.get_renderer().restore_region(region)
+        self.get_renderer().restore_region(region)
         super().draw()
 
     def _print_vector(self, renderer_factory,
@@ -260,8 +496,7 @@ class FigureCanvasCairo(FigureCanvasBase):
                 # rendered needs to be _finish()ed (to avoid later writing to a
                 # closed file).
                 renderer._set_metadata(metadata)
-                with _LOCK:
-                    self.figure.draw(renderer)
+                self.figure.draw(renderer)
             except Exception as exc:
                 draw_raises_done = type(exc).__name__ == "Done"
                 raise
@@ -279,8 +514,7 @@ class FigureCanvasCairo(FigureCanvasBase):
         # (stream = None) in that case.
         if draw_raises_done:
             renderer = renderer_factory(None, *self.figure.bbox.size, dpi)
-            with _LOCK:
-                self.figure.draw(renderer)
+            self.figure.draw(renderer)
 
     print_pdf = partialmethod(
         _print_vector, GraphicsContextRendererCairo._for_pdf_output)
@@ -341,12 +575,14 @@ class FigureCanvasCairo(FigureCanvasBase):
     print_ps = partialmethod(_print_ps_impl, False)
     print_eps = partialmethod(_print_ps_impl, True)
 
-    def _get_fresh_straight_rgba8888(self):
+    def _get_fresh_renderer(self):
         renderer = self.get_renderer()
         renderer.clear()
-        with _LOCK:
-            self.figure.draw(renderer)
-        return _mplcairo.cairo_to_straight_rgba8888(renderer._get_buffer())
+        self.figure.draw(renderer)
+        return renderer
+
+    def _get_fresh_straight_rgba8888(self):
+        return self._get_fresh_renderer().buffer_rgba()
 
     def print_rgba(self, path_or_stream, *,
                    dryrun=False, metadata=None, **kwargs):
@@ -362,26 +598,19 @@ class FigureCanvasCairo(FigureCanvasBase):
     def print_png(self, path_or_stream, *,
                   dryrun=False, metadata=None, pil_kwargs=None, **kwargs):
         _check_print_extra_kwargs(**kwargs)
-        img = self._get_fresh_straight_rgba8888()
+        pil_kwargs = {**pil_kwargs} if pil_kwargs is not None else {}
+        tiled = _use_tiled_png(pil_kwargs, self.figure.bbox.height)
+        if tiled:
+            # Don't allocate (nor cache) a full-size canvas renderer.
+            renderer = GraphicsContextRendererCairo._for_tiled_output(
+                *self.figure.bbox.size, self.figure.dpi)
+            self.figure.draw(renderer)
+        else:
+            renderer = self._get_fresh_renderer()
         if dryrun:
             return
-        metadata = {
-            "Software":
-            f"matplotlib version {get_versions()['matplotlib']}, "
-            f"https://matplotlib.org",
-            **(metadata if metadata is not None else {}),
-        }
-        if pil_kwargs is None:
-            pil_kwargs = {}
-        # Only use the metadata kwarg if pnginfo is not set, because the
-        # semantics of duplicate keys in pnginfo is unclear.
-        if "pnginfo" not in pil_kwargs:
-            pnginfo = PngInfo()
-            for k, v in metadata.items():
-                pnginfo.add_text(k, v)
-            pil_kwargs["pnginfo"] = pnginfo
-        pil_kwargs.setdefault("dpi", (self.figure.dpi, self.figure.dpi))
-        Image.fromarray(img).save(path_or_stream, format="png", **pil_kwargs)
+        _save_png(renderer, path_or_stream, tiled=tiled, dpi=self.figure.dpi,
+                  metadata=metadata, pil_kwargs=pil_kwargs)
 
     def print_jpeg(self, path_or_stream, *,
                    dryrun=False, pil_kwargs=None, **kwargs):
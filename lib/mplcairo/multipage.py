@@ -4,7 +4,7 @@ from pathlib import Path
 
 from matplotlib import cbook, rcParams
 
-from .base import GraphicsContextRendererCairo, _LOCK
+from .base import GraphicsContextRendererCairo
 
 
 class MultiPage:
@@ -50,8 +50,7 @@ class MultiPage:
         figure.set_dpi(72)
         self._renderer._set_size(*figure.canvas.get_width_height(),
                                  kwargs.get("dpi", 72))
-        with _LOCK:
-            figure.draw(self._renderer)
+        figure.draw(self._renderer)
         self._renderer._show_page()
 
     def close(self):
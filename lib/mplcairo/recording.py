@@ -0,0 +1,94 @@
+from pathlib import Path
+
+from matplotlib import cbook, rcParams
+
+from .base import (
+    GraphicsContextRendererCairo, _save_png, _use_tiled_png)
+
+
+class Recording:
+    """
+    A figure drawn once, for output to multiple formats and resolutions.
+
+    Usage::
+
+        rec = Recording(fig)
+        rec.savefig("fig.pdf")
+        rec.savefig("fig.svg")
+        rec.savefig("fig.png", dpi=300)
+
+    The figure's artists are traversed only once, when the `Recording` is
+    created, into a cairo recording surface that is then replayed (natively)
+    for each output; later changes to the figure are not reflected.  Supported
+    formats are EPS, PDF, PNG, PS, SVG and SVGZ.
+
+    Raster outputs are scaled replays of the vector drawing, and may thus
+    slightly differ from the output of `Figure.savefig` (e.g., lines are not
+    snapped to pixels).  `Figure.savefig` options that change the drawing
+    (*bbox_inches*, *facecolor*, etc.) are not supported: set them on the
+    figure before recording it.
+    """
+
+    def __init__(self, figure):
+        # Like vector outputs, record in points, keeping the figure dpi as the
+        # resolution of rasterized elements.
+        self._dpi = figure.get_dpi()
+        figure.set_dpi(72)
+        try:
+            self._size = figure.bbox.size
+            self._renderer = \
+                GraphicsContextRendererCairo._for_recording_output(
+                    None, *self._size, self._dpi)
+            figure.draw(self._renderer)
+        finally:
+            figure.set_dpi(self._dpi)
+
+    def savefig(self, path_or_stream, *, format=None, dpi=None,
+                metadata=None, pil_kwargs=None):
+        """
+        Replay the recording to *path_or_stream*.
+
+        *format* defaults to the extension of *path_or_stream*, then to
+        :rc:`savefig.format`.  *dpi* (which defaults to the dpi of the figure
+        when it was recorded) sets the size of raster outputs, and the
+        resolution of fallback images in vector outputs.  *metadata* and
+        *pil_kwargs* are as for `Figure.savefig`.
+        """
+        if dpi is None:
+            dpi = self._dpi
+        with cbook.open_file_cm(path_or_stream, "wb") as stream:
+            fmt = (format
+                   or Path(getattr(stream, "name", "")).suffix[1:]
+                   or rcParams["savefig.format"]).lower()
+            if fmt == "png":
+                self._save_png(stream, dpi, metadata, pil_kwargs)
+                return
+            try:
+                renderer_factory = {
+                    "eps": GraphicsContextRendererCairo._for_eps_output,
+                    "pdf": GraphicsContextRendererCairo._for_pdf_output,
+                    "ps": GraphicsContextRendererCairo._for_ps_output,
+                    "svg": GraphicsContextRendererCairo._for_svg_output,
+                    "svgz": GraphicsContextRendererCairo._for_svgz_output,
+                }[fmt]
+            except KeyError:
+                raise ValueError(f"Unsupported format: {fmt!r}") from None
+            renderer = renderer_factory(stream, *self._size, dpi)
+            try:
+                renderer._set_metadata(metadata)
+                renderer._replay(self._renderer)
+            finally:
+                # See FigureCanvasCairo._print_vector.
+                renderer._finish()
+
+    def _save_png(self, stream, dpi, metadata, pil_kwargs):
+        width, height = self._size * dpi / 72
+        pil_kwargs = {**pil_kwargs} if pil_kwargs is not None else {}
+        tiled = _use_tiled_png(pil_kwargs, height)
+        renderer = (
+            GraphicsContextRendererCairo._for_tiled_output(width, height, dpi)
+            if tiled else
+            GraphicsContextRendererCairo(width, height, dpi))
+        renderer._replay(self._renderer, dpi / 72)
+        _save_png(renderer, stream, tiled=tiled, dpi=dpi,
+                  metadata=metadata, pil_kwargs=pil_kwargs)
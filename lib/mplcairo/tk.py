@@ -2,7 +2,6 @@ from functools import partial
 
 from matplotlib.backends._backend_tk import _BackendTk, FigureCanvasTk
 
-from . import _mplcairo
 from .base import FigureCanvasCairo
 
 try:
@@ -19,8 +18,7 @@ class FigureCanvasTkCairo(FigureCanvasCairo, FigureCanvasTk):
         self.blit()
 
     def blit(self, bbox=None):
-        buf = _mplcairo.cairo_to_straight_rgba8888(
-            self.get_renderer()._get_buffer())
+        buf = self.get_renderer().buffer_rgba()
         _tk_blit(self._tkphoto, buf, bbox=bbox)
 
 
@@ -115,6 +115,9 @@ class build_ext(build_ext):
                 *get_pkgconfig("--cflags", "cairo"),
             ]
             ext.extra_link_args += ["-flto"]
+            # zlib is needed by the native PNG writer.
+            ext.define_macros += [("MPLCAIRO_USE_ZLIB", None)]
+            ext.libraries += ["z"]
 
         elif os.name == "nt":
             # Windows conda path for FreeType.
@@ -126,12 +129,17 @@ class build_ext(build_ext):
             ext.libraries += ["psapi", "cairo", "freetype"]
             # Windows conda path for FreeType -- needs to be str, not Path.
             ext.library_dirs += [str(Path(sys.prefix, "Library/lib"))]
+            # The native PNG writer is only built if zlib is available (e.g.
+            # from conda); otherwise, PNG output goes through Pillow.
+            if Path(sys.prefix, "Library/include/zlib.h").exists():
+                ext.define_macros += [("MPLCAIRO_USE_ZLIB", None)]
+                ext.libraries += ["zlib"]
 
         super().finalize_options()
 
     def _copy_dlls_to(self, dest):
         if os.name == "nt":
-            for dll in ["cairo.dll", "freetype.dll"]:
+            for dll in ["cairo.dll", "freetype.dll", "zlib.dll"]:
                 for path in paths_from_link_libpaths():
                     if (path / dll).exists():
                         shutil.copy2(path / dll, dest)
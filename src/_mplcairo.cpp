@@ -2,14 +2,20 @@
 
 #include "_os.h"
 #include "_pattern_cache.h"
+#include "_pixel.h"
+#include "_png.h"
 #include "_raqm.h"
+#include "_thread_pool.h"
 #include "_util.h"
 
 #include <py3cairo.h>
 #include <cairo-script.h>
 
+#include <cstring>
+#include <future>
 #include <stack>
 #include <thread>
+#include <unordered_set>
 
 #include "_macros.h"
 
@@ -99,7 +105,8 @@ P11X_DECLARE_ENUM(
   {"PS", mplcairo::StreamSurfaceType::PS},
   {"EPS", mplcairo::StreamSurfaceType::EPS},
   {"SVG", mplcairo::StreamSurfaceType::SVG},
-  {"Script", mplcairo::StreamSurfaceType::Script}
+  {"Script", mplcairo::StreamSurfaceType::Script},
+  {"Recording", mplcairo::StreamSurfaceType::Recording}
 )
 
 namespace mplcairo {
@@ -277,13 +284,6 @@ GraphicsContextRenderer::GraphicsContextRenderer(
 
 GraphicsContextRenderer::~GraphicsContextRenderer()
 {
-  if (detail::FONT_CACHE.size() > 64) {  // font_manager._get_font cache size.
-    for (auto& [pathspec, font_face]: detail::FONT_CACHE) {
-      (void)pathspec;
-      cairo_font_face_destroy(font_face);
-    }
-    detail::FONT_CACHE.clear();  // Naive cache mechanism.
-  }
   try {
 #ifdef _WIN32
     std::cerr << std::flush;  // See below.
@@ -324,6 +324,85 @@ GraphicsContextRenderer::GraphicsContextRenderer(
     std::floor(width), std::floor(height), dpi}
 {}
 
+cairo_t* GraphicsContextRenderer::cr_from_tiled_args(int width, int height)
+{
+  if (width <= 0 || height <= 0) {  // Let image surfaces report invalid sizes.
+    return cr_from_image_args(width, height);
+  }
+  auto const& extents = cairo_rectangle_t{0, 0, double(width), double(height)};
+  auto const& surface =
+    cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+  CAIRO_CHECK_SET_USER_DATA(
+    cairo_surface_set_user_data, surface, &detail::RASTER_RECORDING_KEY,
+    surface, nullptr);
+  auto const& cr = cairo_create(surface);
+  cairo_surface_destroy(surface);
+  return cr;
+}
+
+GraphicsContextRenderer::GraphicsContextRenderer(
+  double width, double height, double dpi, bool tiled) :
+  GraphicsContextRenderer{
+    tiled
+    ? cr_from_tiled_args(int(width), int(height))
+    : cr_from_image_args(int(width), int(height)),
+    std::floor(width), std::floor(height), dpi}
+{}
+
+cairo_t* GraphicsContextRenderer::cr_from_buffer_args(py::buffer buf)
+{
+  auto const& info = buf.request(true);  // Also checks writability.
+  auto const& is_float = info.format == py::format_descriptor<float>::format();
+  if (!is_float && info.format != py::format_descriptor<uint8_t>::format()) {
+    throw std::invalid_argument{
+      "buffer must be of uint8 or float32 type, not {!r}"_format(info.format)
+      .cast<std::string>()};
+  }
+  if (is_float && cairo_version() < CAIRO_VERSION_ENCODE(1, 17, 2)) {
+    throw std::invalid_argument{"float buffers require cairo>=1.17.2"};
+  }
+  auto const& itemsize = info.itemsize;
+  // The row stride is checked by cairo, which only requires 4-byte alignment.
+  if (info.ndim != 3 || info.shape[2] != 4
+      || info.strides[2] != itemsize || info.strides[1] != 4 * itemsize
+      || info.strides[0] < 4 * itemsize * info.shape[1]
+      || reinterpret_cast<uintptr_t>(info.ptr) % 4) {
+    throw std::invalid_argument{
+      "buffer must have shape (height, width, 4), contiguous 4-byte-aligned "
+      "rows, and a positive row stride"};
+  }
+  // Pin the buffer (e.g., prevent a bytearray from being resized, or a mmap
+  // from being closed) and keep it alive as long as the surface is.
+  auto const& view = py::reinterpret_steal<py::object>(
+    PyMemoryView_FromObject(buf.ptr()));
+  if (!view) {
+    throw py::error_already_set{};
+  }
+  auto const& surface = cairo_image_surface_create_for_data(
+    static_cast<unsigned char*>(info.ptr),
+    is_float ? static_cast<cairo_format_t>(7) : CAIRO_FORMAT_ARGB32,
+    info.shape[1], info.shape[0], info.strides[0]);
+  CAIRO_CHECK(cairo_surface_status, surface);
+  CAIRO_CHECK_SET_USER_DATA(
+    cairo_surface_set_user_data, surface, &detail::REFS_KEY,
+    new std::vector<py::object>{{view}},
+    [](void* data) -> void {
+      // The surface may outlive the renderer (see _get_buffer).
+      auto const& gil = py::gil_scoped_acquire{};
+      delete static_cast<std::vector<py::object>*>(data);
+    });
+  auto const& cr = cairo_create(surface);
+  cairo_surface_destroy(surface);
+  return cr;
+}
+
+GraphicsContextRenderer::GraphicsContextRenderer(py::buffer buf, double dpi) :
+  GraphicsContextRenderer{
+    // List-initialization evaluates the buffer checks first.
+    cr_from_buffer_args(buf),
+    double(buf.request().shape[1]), double(buf.request().shape[0]), dpi}
+{}
+
 cairo_t* GraphicsContextRenderer::cr_from_pycairo_ctx(
   py::object ctx, std::tuple<double, double> device_scales)
 {
@@ -384,6 +463,14 @@ cairo_t* GraphicsContextRenderer::cr_from_fileformat_args(
               cairo_device_destroy(script);
               return surface;
             };
+        case StreamSurfaceType::Recording:  // Ignores the stream.
+          return
+            [](cairo_write_func_t, void*, double width, double height)
+              -> cairo_surface_t* {
+              auto const& extents = cairo_rectangle_t{0, 0, width, height};
+              return cairo_recording_surface_create(
+                CAIRO_CONTENT_COLOR_ALPHA, &extents);
+            };
         default:
           return nullptr;
       }
@@ -397,6 +484,8 @@ cairo_t* GraphicsContextRenderer::cr_from_fileformat_args(
     ? cairo_write_func_t{
       [](void* closure, unsigned char const* data, unsigned int length)
         -> cairo_status_t {
+          // cairo may flush output while the GIL is released.
+          auto const& gil = py::gil_scoped_acquire{};
           auto const& write =
             py::reinterpret_borrow<py::object>(static_cast<PyObject*>(closure));
           auto const& written =
@@ -644,9 +733,174 @@ py::array GraphicsContextRenderer::_get_buffer()
   return image_surface_to_buffer(cairo_get_target(cr_));
 }
 
+void GraphicsContextRenderer::_replay(
+  GraphicsContextRenderer& recording, double scale)
+{
+  auto const& source = cairo_get_target(recording.cr_);
+  if (auto const& type = cairo_surface_get_type(source);
+      type != CAIRO_SURFACE_TYPE_RECORDING) {
+    throw std::invalid_argument{
+      "can only replay recordings, not {.name} surfaces"_format(type)
+      .cast<std::string>()};
+  }
+  cairo_surface_flush(source);
+  cairo_save(cr_);
+  cairo_scale(cr_, scale, scale);
+  cairo_set_source_surface(cr_, source, 0, 0);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    cairo_paint(cr_);
+  }
+  cairo_restore(cr_);
+  CAIRO_CHECK(cairo_status, cr_);
+}
+
+#ifdef MPLCAIRO_USE_ZLIB
+void GraphicsContextRenderer::_write_tiled_png(
+  py::object file, int compress_level, std::string filter,
+  py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+  std::optional<int> threads)
+{
+  auto const& target = cairo_get_target(cr_);
+  if (!cairo_surface_get_user_data(target, &detail::RASTER_RECORDING_KEY)) {
+    throw std::runtime_error{"_write_tiled_png requires a tiled renderer"};
+  }
+  cairo_surface_flush(target);
+  auto const& width = size_t(get_additional_state().width),
+            & height = size_t(get_additional_state().height);
+  auto const& format = get_cairo_format();
+  // Replaying a recording mutates scratch state stored on it and on the
+  // sources it draws (e.g., the snapshots of hatch patterns and of nested
+  // recordings), which copies of the recording would still share.  Thus,
+  // bands are replayed one at a time, from the recording itself; they are
+  // still converted and compressed in parallel.
+  auto mutex = std::mutex{};
+  auto source = RowSource{width, height};
+  source.convert = [&](size_t start, size_t stop, uint8_t* dst) {
+    auto const& n = width * (stop - start);
+    // Float tiles are rendered to a temporary buffer, then converted in place.
+    auto float_buf = std::unique_ptr<float[]>{};
+    if (format != CAIRO_FORMAT_ARGB32) {
+      float_buf.reset(new float[4 * n]{});
+    } else {
+      std::memset(dst, 0, 4 * n);
+    }
+    auto const& tile =
+      float_buf
+      ? cairo_image_surface_create_for_data(
+          reinterpret_cast<uint8_t*>(float_buf.get()), format,
+          width, stop - start, 16 * width)
+      : cairo_image_surface_create_for_data(
+          dst, format, width, stop - start, 4 * width);
+    auto const& status = [&] {
+      auto const& lock = std::lock_guard{mutex};
+      auto const& cr = cairo_create(tile);
+      cairo_surface_destroy(tile);
+      cairo_set_source_surface(cr, target, 0, -double(start));
+      cairo_paint(cr);
+      auto const& status = cairo_status(cr);
+      cairo_destroy(cr);
+      return status;
+    }();
+    if (status != CAIRO_STATUS_SUCCESS) {  // Not THROW_ERROR: no GIL here.
+      throw std::runtime_error{cairo_status_to_string(status)};
+    }
+    if (float_buf) {
+      pixel::rgba128f_to_argb32(float_buf.get(), dst, n);
+    }
+    pixel::argb32_to_straight_rgba8888(dst, dst, n);
+  };
+  source.block_rows = size_t(std::max(detail::TILE_HEIGHT, 1));
+  source.prefetch = size_t(std::max(detail::CONVERSION_THREADS, 1));
+  write_png_rows(source, file, compress_level, filter, metadata, dpi, threads);
+}
+#endif
+
+// Writer of the external images of an SVG (with svg.image_inline=False),
+// attached to its cairo_t.  As in Matplotlib, images are numbered
+// sequentially, but indices of preexisting files (listed once) are skipped, to
+// avoid overwriting them.  Images are encoded and written on the thread pool,
+// and waited for by _finish (or on destruction).
+struct ExternalImageWriter {
+  std::string path, basename;
+  std::unordered_set<std::string> existing;
+  int next_index;
+  std::vector<std::future<void>> writes;
+
+  ExternalImageWriter(std::string path) : path{path}, next_index{}
+  {
+    auto const& os = py::module::import("os");
+    basename = os.attr("path").attr("basename")(path).cast<std::string>();
+    auto dir = os.attr("path").attr("dirname")(path);
+    if (!py::bool_(dir)) {
+      dir = py::str(".");
+    }
+    for (auto const& name: os.attr("listdir")(dir)) {
+      existing.insert(name.cast<std::string>());
+    }
+  }
+
+  ~ExternalImageWriter()
+  {
+    for (auto& write: writes) {
+      write.wait();  // Errors were already reported by _finish, if called.
+    }
+  }
+
+  std::string reserve_path()
+  {
+    while (existing.count(
+             basename + ".image" + std::to_string(next_index) + ".png")) {
+      ++next_index;
+    }
+    return path + ".image" + std::to_string(next_index++) + ".png";
+  }
+
+  void write(cairo_surface_t* surface, std::string image_path)
+  {
+    cairo_surface_reference(surface);
+    writes.push_back(ThreadPool::get().submit([surface, image_path] {
+      auto const& status =
+        cairo_surface_write_to_png(surface, image_path.c_str());
+      cairo_surface_destroy(surface);
+      if (status != CAIRO_STATUS_SUCCESS) {
+        THROW_ERROR(
+          "cairo_surface_write_to_png", cairo_status_to_string(status));
+      }
+    }));
+  }
+
+  // Wait for all pending writes, rethrowing the first error, if any.
+  void wait()
+  {
+    auto error = std::exception_ptr{};
+    {
+      auto const& nogil = py::gil_scoped_release{};
+      for (auto& write: writes) {
+        try {
+          write.get();
+        } catch (...) {
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+    }
+    writes.clear();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
 void GraphicsContextRenderer::_finish()
 {
   cairo_surface_finish(cairo_get_target(cr_));
+  if (auto const& writer =
+        static_cast<ExternalImageWriter*>(
+          cairo_get_user_data(cr_, &detail::EXTERNAL_IMAGES_KEY))) {
+    writer->wait();
+  }
 }
 
 void GraphicsContextRenderer::set_alpha(std::optional<double> alpha)
@@ -845,9 +1099,177 @@ double GraphicsContextRenderer::points_to_pixels(double points)
   return points * get_additional_state().dpi / 72;
 }
 
+// Transform n (x, y) pairs from src into dst.  This loop is simple enough to
+// be vectorized by the compiler, including the conversion from float.
+template<typename T>
+void transform_points(
+  cairo_matrix_t const& mtx, T const* src, double* dst, ssize_t n)
+{
+  auto const xx = mtx.xx, yx = mtx.yx, xy = mtx.xy, yy = mtx.yy,
+             x0 = mtx.x0, y0 = mtx.y0;
+  for (auto k = ssize_t{}; k < n; ++k) {
+    auto const x = double(src[2 * k]), y = double(src[2 * k + 1]);
+    dst[2 * k] = xx * x + xy * y + x0;
+    dst[2 * k + 1] = yx * x + yy * y + y0;
+  }
+}
+
+// Rasterize Gouraud-shaded triangles, whose vertices (n * 3 (x, y) pairs) are
+// given in device space, over the pixels [left, left + width) x [top, top +
+// height), into a new image surface of the given format (ARGB32 or RGBA128F).
+// Each pixel is supersampled over a samples x samples grid.  Triangle edges
+// are evaluated identically by both triangles sharing them, and spans are
+// half-open, so that each sample is covered by at most one triangle of a
+// mesh: there are no conflation artefacts at internal edges.  Colors are
+// interpolated in premultiplied space, and overlapping triangles are
+// composited in order.  The image is split into bands of rows, to which the
+// triangles are binned, and which are rendered in parallel.  Must be called
+// without the GIL.
+template<typename C>
+cairo_surface_t* rasterize_gouraud_triangles(
+  double const* vertices, C const& colors, ssize_t n,
+  int left, int top, int width, int height, int samples, cairo_format_t format)
+{
+  auto const& band_height = 16,
+            & n_bands = (height + band_height - 1) / band_height;
+  auto bins = std::vector<std::vector<ssize_t>>(n_bands);
+  for (auto i = 0; i < n; ++i) {
+    auto const& v = vertices + 6 * i;
+    if (!std::all_of(v, v + 6, [](double x) { return std::isfinite(x); })) {
+      continue;
+    }
+    auto const& [y0, y1] = std::minmax({v[1], v[3], v[5]});
+    auto const b0 = std::clamp(
+                 std::floor((y0 - top) / band_height), 0., double(n_bands)),
+               b1 = std::clamp(
+                 std::floor((y1 - top) / band_height), -1., n_bands - 1.);
+    for (auto b = int(b0); b <= int(b1); ++b) {
+      bins[b].push_back(i);
+    }
+  }
+  struct Triangle {
+    double x[3], y[3];  // Sorted by (y, x).
+    float color[4], dcdx[4], dcdy[4];
+  };
+  // The x coordinate of the edge from vertex j to vertex k > j, at height y.
+  auto const& edge = [](Triangle const& t, int j, int k, double y) {
+    return t.x[j] + (y - t.y[j]) * (t.x[k] - t.x[j]) / (t.y[k] - t.y[j]);
+  };
+  auto const& surface = cairo_image_surface_create(format, width, height);
+  auto const& data = cairo_image_surface_get_data(surface);
+  auto const& stride = cairo_image_surface_get_stride(surface);
+  cairo_surface_flush(surface);
+  maybe_parallel_for(
+    n_bands, band_height * width, [&](ssize_t start, ssize_t stop) {
+      auto triangles = std::vector<Triangle>{};
+      // The samples of a row of pixels, as samples rows of width * samples
+      // premultiplied RGBA floats; then the resolved pixels.
+      auto row_samples = std::vector<float>(4 * samples * width * samples);
+      auto row = std::vector<float>(4 * width);
+      for (auto b = start; b < stop; ++b) {
+        triangles.clear();
+        for (auto const& i: bins[b]) {
+          auto const& p = vertices + 6 * i;
+          int order[3] = {0, 1, 2};
+          std::sort(order, order + 3, [&](int j, int k) {
+            return std::tie(p[2 * j + 1], p[2 * j])
+                   < std::tie(p[2 * k + 1], p[2 * k]);
+          });
+          auto t = Triangle{};
+          double c[3][4];
+          for (auto j = 0; j < 3; ++j) {
+            t.x[j] = p[2 * order[j]];
+            t.y[j] = p[2 * order[j] + 1];
+            auto const a = std::clamp(colors(i, order[j], 3), 0., 1.);
+            for (auto k = 0; k < 3; ++k) {
+              c[j][k] = std::clamp(colors(i, order[j], k), 0., 1.) * a;
+            }
+            c[j][3] = a;
+          }
+          auto const& dx1 = t.x[1] - t.x[0], & dy1 = t.y[1] - t.y[0],
+                    & dx2 = t.x[2] - t.x[0], & dy2 = t.y[2] - t.y[0],
+                    & det = dx1 * dy2 - dx2 * dy1;
+          if (!det) {  // Degenerate; covers no samples.
+            continue;
+          }
+          for (auto k = 0; k < 4; ++k) {
+            auto const& dc1 = c[1][k] - c[0][k], & dc2 = c[2][k] - c[0][k];
+            t.color[k] = c[0][k];
+            t.dcdx[k] = (dc1 * dy2 - dc2 * dy1) / det;
+            t.dcdy[k] = (dc2 * dx1 - dc1 * dx2) / det;
+          }
+          triangles.push_back(t);
+        }
+        auto const v_stop = std::min((b + 1) * band_height, ssize_t(height));
+        for (auto v = b * band_height; v < v_stop; ++v) {
+          std::fill(row_samples.begin(), row_samples.end(), 0);
+          for (auto const& t: triangles) {
+            if (t.y[2] <= top + v || t.y[0] >= top + v + 1) {
+              continue;
+            }
+            for (auto s = 0; s < samples; ++s) {
+              auto const& y = top + v + (s + .5) / samples;
+              if (y < t.y[0] || y >= t.y[2]) {
+                continue;
+              }
+              auto const& [xl, xr] = std::minmax({
+                edge(t, 0, 2, y),
+                y < t.y[1] ? edge(t, 0, 1, y) : edge(t, 1, 2, y)});
+              // Samples are at x = left + (k + .5) / samples; xl <= x < xr.
+              auto const& k0 = ssize_t(std::clamp(
+                           std::ceil((xl - left) * samples - .5),
+                           0., double(width * samples))),
+                        & k1 = ssize_t(std::clamp(
+                           std::ceil((xr - left) * samples - .5),
+                           0., double(width * samples)));
+              if (k0 >= k1) {
+                continue;
+              }
+              auto const& x = left + (k0 + .5) / samples;
+              float color[4], step[4];
+              for (auto k = 0; k < 4; ++k) {
+                color[k] =
+                  t.color[k] + t.dcdx[k] * (x - t.x[0])
+                  + t.dcdy[k] * (y - t.y[0]);
+                step[k] = t.dcdx[k] / samples;
+              }
+              pixel::rgba128f_over_gradient(
+                row_samples.data() + 4 * (s * width * samples + k0),
+                color, step, k1 - k0);
+            }
+          }
+          auto const& scale = 1.f / (samples * samples);
+          for (auto u = 0; u < width; ++u) {
+            float sum[4] = {};
+            for (auto s = 0; s < samples; ++s) {
+              auto const& src =
+                row_samples.data() + 4 * (s * width * samples + u * samples);
+              for (auto j = 0; j < 4 * samples; ++j) {
+                sum[j % 4] += src[j];
+              }
+            }
+            auto const a = std::clamp(sum[3] * scale, 0.f, 1.f);
+            for (auto k = 0; k < 3; ++k) {
+              row[4 * u + k] = std::clamp(sum[k] * scale, 0.f, a);
+            }
+            row[4 * u + 3] = a;
+          }
+          auto const& dst = data + v * stride;
+          if (format == CAIRO_FORMAT_ARGB32) {
+            pixel::rgba128f_to_argb32(row.data(), dst, width);
+          } else {
+            std::memcpy(dst, row.data(), 4 * width * sizeof(float));
+          }
+        }
+      }
+    });
+  cairo_surface_mark_dirty(surface);
+  return surface;
+}
+
 void GraphicsContextRenderer::draw_gouraud_triangles(
   GraphicsContextRenderer& gc,
-  py::array_t<double> triangles,
+  py::array_t<double, py::array::c_style | py::array::forcecast> triangles,
   py::array_t<double> colors,
   py::object transform)
 {
@@ -867,6 +1289,53 @@ void GraphicsContextRenderer::draw_gouraud_triangles(
         triangles, colors)
       .cast<std::string>()};
   }
+  // On raster surfaces, use the native rasterizer (cairo's mesh rasterizer is
+  // single-threaded and slow).  Device-scaled surfaces are left to cairo.
+  auto const& target = cairo_get_group_target(cr_);
+  auto sx = 1., sy = 1.;
+  if (detail::cairo_surface_get_device_scale) {
+    detail::cairo_surface_get_device_scale(target, &sx, &sy);
+  }
+  if (cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE
+      && sx == 1 && sy == 1) {
+    auto ctm = cairo_matrix_t{};
+    cairo_get_matrix(cr_, &ctm);
+    cairo_matrix_multiply(&mtx, &mtx, &ctm);
+    auto const& samples =
+      cairo_get_antialias(cr_) == CAIRO_ANTIALIAS_NONE ? 1 : 4;
+    // Match the target (which may predate a change of float_surface), so
+    // that cairo need not convert the result.
+    auto const& format =
+      static_cast<int>(cairo_image_surface_get_format(target)) == 7
+      ? static_cast<cairo_format_t>(7)  // CAIRO_FORMAT_RGBA128F.
+      : CAIRO_FORMAT_ARGB32;
+    cairo_identity_matrix(cr_);
+    auto const& nogil = py::gil_scoped_release{};
+    auto vertices = std::vector<double>(6 * n);
+    transform_points(mtx, triangles.data(), vertices.data(), 3 * n);
+    auto x0 = 0., y0 = 0., x1 = 0., y1 = 0.;
+    cairo_clip_extents(cr_, &x0, &y0, &x1, &y1);
+    auto tx0 = INFINITY, ty0 = INFINITY, tx1 = -INFINITY, ty1 = -INFINITY;
+    for (auto k = 0; k < 3 * n; ++k) {
+      auto const& x = vertices[2 * k], & y = vertices[2 * k + 1];
+      if (std::isfinite(x) && std::isfinite(y)) {
+        tx0 = std::min(tx0, x), tx1 = std::max(tx1, x);
+        ty0 = std::min(ty0, y), ty1 = std::max(ty1, y);
+      }
+    }
+    x0 = std::floor(std::max(x0, tx0)), x1 = std::ceil(std::min(x1, tx1));
+    y0 = std::floor(std::max(y0, ty0)), y1 = std::ceil(std::min(y1, ty1));
+    if (x0 >= x1 || y0 >= y1) {
+      return;
+    }
+    auto const& surface = rasterize_gouraud_triangles(
+      vertices.data(), col_raw, n,
+      int(x0), int(y0), int(x1 - x0), int(y1 - y0), samples, format);
+    cairo_set_source_surface(cr_, surface, x0, y0);
+    cairo_surface_destroy(surface);
+    cairo_paint(cr_);
+    return;
+  }
   auto const& pattern = cairo_pattern_create_mesh();
   for (auto i = 0; i < n; ++i) {
     cairo_mesh_pattern_begin_patch(pattern);
@@ -883,67 +1352,116 @@ void GraphicsContextRenderer::draw_gouraud_triangles(
   cairo_pattern_set_matrix(pattern, &mtx);
   cairo_set_source(cr_, pattern);
   cairo_pattern_destroy(pattern);
-  cairo_paint(cr_);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    cairo_paint(cr_);
+  }
 }
 
 void GraphicsContextRenderer::draw_image(
-  GraphicsContextRenderer& gc, double x, double y, py::array_t<uint8_t> im)
+  GraphicsContextRenderer& gc, double x, double y,
+  py::array_t<uint8_t, py::array::c_style | py::array::forcecast> im)
 {
   if (&gc != this) {
     throw std::invalid_argument{"non-matching GraphicsContext"};
   }
   auto const& ac = _additional_context();
-  auto const& im_raw = im.unchecked<3>();
-  auto const& height = im_raw.shape(0), width = im_raw.shape(1);
-  if (im_raw.shape(2) != 4) {
+  if (im.ndim() != 3 || im.shape(2) != 4) {
     throw std::invalid_argument{
       "RGBA array must have shape (m, n, 4), not {.shape}"_format(im)
       .cast<std::string>()};
   }
-  // Let cairo manage the surface memory; as some backends only write the image
-  // at flush time.
-  auto const& surface =
-    cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-  auto const& data = cairo_image_surface_get_data(surface);
-  auto const& stride = cairo_image_surface_get_stride(surface);
-  cairo_surface_flush(surface);
-  // The gcr's alpha has already been applied by ImageBase._make_image, we just
-  // need to convert to premultiplied ARGB format.
-  for (auto i = 0; i < height; ++i) {
-    auto ptr = reinterpret_cast<uint32_t*>(data + i * stride);
-    for (auto j = 0; j < width; ++j) {
-      auto r = im_raw(i, j, 0),
-           g = im_raw(i, j, 1),
-           b = im_raw(i, j, 2),
-           a = im_raw(i, j, 3);
-      if (a != 0xff) {
-        auto subtable = &detail::premultiplication_table[a << 8];
-        r = subtable[r];
-        g = subtable[g];
-        b = subtable[b];
-      }
-      *ptr++ = (a << 24) + (r << 16) + (g << 8) + (b << 0);
+  auto const& height = im.shape(0), & width = im.shape(1);
+  auto const& external_svg =
+    cairo_surface_get_type(cairo_get_target(cr_)) == CAIRO_SURFACE_TYPE_SVG
+    && !rc_param("svg.image_inline").cast<bool>();
+  // Surfaces given a per-draw filename (below) cannot be shared.
+  auto const& cached = detail::IMAGE_CACHE_SIZE > 0 && !external_svg;
+  auto const& digest =
+    cached || (has_vector_surface(cr_) && !external_svg)
+    ? image_digest(im) : std::string{};
+  auto surface = static_cast<cairo_surface_t*>(nullptr);
+  if (cached) {
+    auto const& lock = std::lock_guard{detail::IMAGE_CACHE_MUTEX};
+    surface = detail::IMAGE_CACHE.get(digest);
+  }
+  if (!surface) {
+    // Let cairo manage the surface memory; as some backends only write the
+    // image at flush time.
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    auto const& src = im.data();
+    auto const& dst = cairo_image_surface_get_data(surface);
+    auto const& stride = cairo_image_surface_get_stride(surface);
+    cairo_surface_flush(surface);
+    // The gcr's alpha has already been applied by ImageBase._make_image, we
+    // just need to convert to premultiplied ARGB format.
+    {
+      auto const& nogil = py::gil_scoped_release{};
+      maybe_parallel_for(height, width, [&](ssize_t start, ssize_t stop) {
+        for (auto i = start; i < stop; ++i) {
+          pixel::straight_rgba8888_to_argb32(
+            src + 4 * width * i, dst + stride * i, width);
+        }
+      });
+    }
+    cairo_surface_mark_dirty(surface);
+    if (cached) {
+      auto const& lock = std::lock_guard{detail::IMAGE_CACHE_MUTEX};
+      detail::IMAGE_CACHE.put(digest, surface);
     }
   }
-  cairo_surface_mark_dirty(surface);
-  if (cairo_surface_get_type(cairo_get_target(cr_)) == CAIRO_SURFACE_TYPE_SVG
-      && !rc_param("svg.image_inline").cast<bool>()) {
+  if (cached) {
+    // cairo attaches snapshots to source surfaces (without locking) when
+    // recording them or writing them to vector outputs, so the cached surface,
+    // which is shared across threads, is never used directly as a source.
+    // Instead, each draw uses its own surface sharing the (read-only) pixels.
+    auto const& view = cairo_image_surface_create_for_data(
+      cairo_image_surface_get_data(surface), CAIRO_FORMAT_ARGB32,
+      width, height, cairo_image_surface_get_stride(surface));
+    auto view_cleanup =  // In case set_user_data fails; released below.
+      std::unique_ptr<cairo_surface_t, decltype(&cairo_surface_destroy)>{
+        view, cairo_surface_destroy};
+    // Steals the reference to surface; also fails (destroying it) if the view
+    // could not be created.
+    CAIRO_CHECK_SET_USER_DATA(
+      cairo_surface_set_user_data, view, &detail::PIXELS_OWNER_KEY, surface,
+      [](void* data) -> void {
+        cairo_surface_destroy(static_cast<cairo_surface_t*>(data));
+      });
+    surface = view_cleanup.release();
+  }
+  if (digest.size()) {
+    // Let vector backends embed identical images (drawn multiple times,
+    // possibly on different pages) only once.
+    auto const& id_ptr = new std::string{digest};
+    CAIRO_CHECK(
+      cairo_surface_set_mime_data,
+      surface,
+      CAIRO_MIME_TYPE_UNIQUE_ID,
+      reinterpret_cast<uint8_t const*>(id_ptr->c_str()),
+      id_ptr->size(),
+      [](void* data) -> void {
+        delete static_cast<std::string*>(data);
+      },
+      id_ptr);
+  }
+  if (external_svg) {
     if (!path_) {
       throw std::runtime_error{
         "cannot save images to filesystem when writing to a non-file stream"};
     }
-    auto image_path_ptr = new std::string{};
-    for (auto i = 0;; ++i) {
-      *image_path_ptr = *path_ + ".image" + std::to_string(i) + ".png";
-      // Matplotlib uses a hard counter.  Checking for file existence avoids
-      // both the need for the counter *and* the risk of overwriting
-      // preexisting files.
-      if (!py::module::import("os.path").attr("exists")(*image_path_ptr)
-           .cast<bool>()) {
-        break;
-      }
+    auto writer =
+      static_cast<ExternalImageWriter*>(
+        cairo_get_user_data(cr_, &detail::EXTERNAL_IMAGES_KEY));
+    if (!writer) {
+      writer = new ExternalImageWriter{*path_};
+      CAIRO_CHECK_SET_USER_DATA(
+        cairo_set_user_data, cr_, &detail::EXTERNAL_IMAGES_KEY, writer,
+        [](void* data) -> void {
+          delete static_cast<ExternalImageWriter*>(data);
+        });
     }
-    CAIRO_CHECK(cairo_surface_write_to_png, surface, image_path_ptr->c_str());
+    auto image_path_ptr = new std::string{writer->reserve_path()};
     CAIRO_CHECK(
       cairo_surface_set_mime_data,
       surface,
@@ -954,6 +1472,7 @@ void GraphicsContextRenderer::draw_image(
         delete static_cast<std::string*>(data);
       },
       image_path_ptr);
+    writer->write(surface, *image_path_ptr);
   }
   auto const& pattern = cairo_pattern_create_for_surface(surface);
   cairo_surface_destroy(surface);
@@ -962,7 +1481,10 @@ void GraphicsContextRenderer::draw_image(
   cairo_pattern_set_matrix(pattern, &mtx);
   cairo_set_source(cr_, pattern);
   cairo_pattern_destroy(pattern);
-  cairo_paint(cr_);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    cairo_paint(cr_);
+  }
 }
 
 void GraphicsContextRenderer::draw_path(
@@ -1001,7 +1523,10 @@ void GraphicsContextRenderer::draw_path(
     cairo_save(cr_);
     auto const& [r, g, b, a] = to_rgba(*fc, get_additional_state().alpha);
     cairo_set_source_rgba(cr_, r, g, b, a);
-    cairo_fill_preserve(cr_);
+    {
+      auto const& nogil = py::gil_scoped_release{};
+      cairo_fill_preserve(cr_);
+    }
     cairo_restore(cr_);
   }
   if (hatch_path) {
@@ -1034,12 +1559,14 @@ void GraphicsContextRenderer::draw_path(
   auto const& chunksize = rc_param("agg.path.chunksize").cast<int>();
   if (path_loaded || !chunksize || !path.attr("codes").is_none()) {
     load_path();
+    auto const& nogil = py::gil_scoped_release{};
     cairo_stroke(cr_);
   } else {
     auto const& vertices = path.attr("vertices").cast<py::array_t<double>>();
     auto const& n = vertices.shape(0);
     for (auto i = decltype(n)(0); i < n; i += chunksize) {
       load_path_exact(cr_, vertices, i, std::min(i + chunksize + 1, n), &mtx);
+      auto const& nogil = py::gil_scoped_release{};
       cairo_stroke(cr_);
     }
   }
@@ -1047,7 +1574,10 @@ void GraphicsContextRenderer::draw_path(
 
 template<typename T>
 void maybe_multithread(cairo_t* cr, int n, T /* lambda */ worker) {
-  if (detail::COLLECTION_THREADS) {
+  // Recordings (for tiled output) would be flattened by the full-size images.
+  if (detail::COLLECTION_THREADS
+      && cairo_surface_get_type(cairo_get_target(cr))
+         == CAIRO_SURFACE_TYPE_IMAGE) {
     auto const& chunk_size =
       int(std::ceil(double(n) / detail::COLLECTION_THREADS));
     auto ctxs = std::vector<cairo_t*>{};
@@ -1229,7 +1759,9 @@ void GraphicsContextRenderer::draw_markers(
       cairo_pattern_destroy(patterns[i]);
     }
 
-  } else if (is_pixel_marker && !has_vector_surface(cr_)) {
+  } else if (is_pixel_marker
+             && cairo_surface_get_type(cairo_get_target(cr_))
+                == CAIRO_SURFACE_TYPE_IMAGE) {
     auto const& surface = cairo_get_target(cr_);
     auto const& raw = cairo_image_surface_get_data(surface);
     auto const& stride = cairo_image_surface_get_stride(surface);
@@ -1362,6 +1894,24 @@ void GraphicsContextRenderer::draw_path_collection(
     has_vector_surface(cr_)
     ? 0 : rc_param("path.simplify_threshold").cast<double>();
   auto points_to_pixels_factor = get_additional_state().dpi / 72;
+  // Unfilled collections (e.g., LineCollections) whose edges all have the
+  // same opaque color, width, and dashes are stroked as a few large merged
+  // paths, rather than item by item: as opaque strokes hide whatever they
+  // overlap, this does not change the result (except for antialiasing where
+  // items overlap).
+  auto merge_strokes =
+    !fcs_raw.shape(0) && ecs_raw.shape(0) && ecs_raw(0, 3) == 1;
+  for (auto i = 1; merge_strokes && i < ecs_raw.shape(0); ++i) {
+    for (auto k = 0; k < 4; ++k) {
+      merge_strokes &= ecs_raw(i, k) == ecs_raw(0, k);
+    }
+  }
+  for (auto i = 1; merge_strokes && i < lws_raw.shape(0); ++i) {
+    merge_strokes &= lws_raw[i] == lws_raw[0];
+  }
+  for (auto i = 1u; merge_strokes && i < n_dashes; ++i) {
+    merge_strokes &= dashes_raw[i] == dashes_raw[0];
+  }
 
   maybe_multithread(cr_, n, [&](cairo_t* ctx, int start, int stop) {
     if (ctx != cr_) {
@@ -1373,6 +1923,54 @@ void GraphicsContextRenderer::draw_path_collection(
           delete static_cast<std::stack<AdditionalState>*>(data);
         });
     }
+    if (merge_strokes) {
+      cairo_save(ctx);
+      restore_init_matrix(ctx);  // Paths are loaded in that space.
+      cairo_set_source_rgba(
+        ctx, ecs_raw(0, 0), ecs_raw(0, 1), ecs_raw(0, 2), ecs_raw(0, 3));
+      auto const& lw = lws_raw.size()
+        ? points_to_pixels_factor * lws_raw[0]
+        : cairo_get_line_width(ctx);
+      cairo_set_line_width(ctx, lw);
+      cairo_set_miter_limit(
+        ctx, detail::MITER_LIMIT >= 0 ? detail::MITER_LIMIT : lw);
+      set_dashes(ctx, dashes_raw[0]);
+      auto merged = std::vector<cairo_path_data_t>{};
+      auto const& stroke_merged = [&] {
+        auto const& path = cairo_path_t{
+          CAIRO_STATUS_SUCCESS, merged.data(), int(merged.size())};
+        cairo_new_path(ctx);
+        cairo_append_path(ctx, &path);
+        merged.clear();
+        // Only the main thread holds the GIL.
+        auto nogil = std::optional<py::gil_scoped_release>{};
+        if (ctx == cr_) {
+          nogil.emplace();
+        }
+        cairo_stroke(ctx);
+      };
+      for (auto i = start; i < stop; ++i) {
+        auto const& mtx = matrices[i % n_transforms];
+        auto x = offsets_raw(i % n_offsets, 0),
+             y = offsets_raw(i % n_offsets, 1);
+        cairo_matrix_transform_point(&offset_matrix, &x, &y);
+        if (!(std::isfinite(x) && std::isfinite(y))) {
+          continue;
+        }
+        auto const& m = cairo_matrix_t{
+          mtx.xx, mtx.yx, mtx.xy, mtx.yy, mtx.x0 + x, mtx.y0 + y};
+        load_path_exact(ctx, paths[i % n_paths], &m);
+        auto const& item = cairo_copy_path(ctx);
+        merged.insert(merged.end(), item->data, item->data + item->num_data);
+        cairo_path_destroy(item);
+        if (merged.size() >= 1 << 20) {  // Bound the merged paths' size.
+          stroke_merged();
+        }
+      }
+      stroke_merged();
+      cairo_restore(ctx);
+      return;
+    }
     auto cache = PatternCache{simplify_threshold};
     for (auto i = start; i < stop; ++i) {
       auto const& path = paths[i % n_paths];
@@ -1410,6 +2008,215 @@ void GraphicsContextRenderer::draw_path_collection(
   get_additional_state().snap = old_snap;
 }
 
+// Draw a quad mesh whose (transformed) coordinates form a rectilinear grid,
+// i.e. x only depends on the column and y on the row, both monotonically, as
+// an image in which each pixel takes the color of the cell containing its
+// center.  Returns false, without drawing anything, if the grid is not
+// rectilinear, or if the target is device-scaled (as the image would then be
+// rasterized below the device resolution).  Must be called without the GIL.
+template<typename C, typename F>
+bool draw_rectilinear_quad_mesh(
+  cairo_t* cr, ssize_t mesh_width, ssize_t mesh_height,
+  C const& coords, F const& fcs)
+{
+  auto sx = 1., sy = 1.;
+  if (detail::cairo_surface_get_device_scale) {
+    detail::cairo_surface_get_device_scale(
+      cairo_get_group_target(cr), &sx, &sy);
+  }
+  if (sx != 1 || sy != 1) {
+    return false;
+  }
+  for (auto i = 0; i <= mesh_height; ++i) {
+    for (auto j = 0; j <= mesh_width; ++j) {
+      if (coords(i, j, 0) != coords(0, j, 0)
+          || coords(i, j, 1) != coords(i, 0, 1)) {
+        return false;
+      }
+    }
+  }
+  auto const& xs = [&](ssize_t j) { return coords(0, j, 0); };
+  auto const& ys = [&](ssize_t i) { return coords(i, 0, 1); };
+  auto const& is_monotonic = [](auto const& at, ssize_t n) {
+    auto increasing = true, decreasing = true;
+    for (auto k = 1; k <= n; ++k) {
+      increasing &= at(k) >= at(k - 1);
+      decreasing &= at(k) <= at(k - 1);
+    }
+    return (increasing || decreasing) && at(0) != at(n);
+  };
+  if (!is_monotonic(xs, mesh_width) || !is_monotonic(ys, mesh_height)) {
+    return false;
+  }
+  // Only rasterize the part of the mesh within the clip.
+  auto cx0 = 0., cy0 = 0., cx1 = 0., cy1 = 0.;
+  cairo_clip_extents(cr, &cx0, &cy0, &cx1, &cy1);
+  auto const& left = int(std::floor(
+              std::max(std::min(xs(0), xs(mesh_width)), cx0))),
+            & top = int(std::floor(
+              std::max(std::min(ys(0), ys(mesh_height)), cy0))),
+            & width = int(std::ceil(
+              std::min(std::max(xs(0), xs(mesh_width)), cx1))) - left,
+            & height = int(std::ceil(
+              std::min(std::max(ys(0), ys(mesh_height)), cy1))) - top;
+  if (width <= 0 || height <= 0) {
+    return true;
+  }
+  // Map each pixel column (row) to the index of the cell column (row)
+  // containing its center, or -1.
+  auto const& cell_indices =
+    [](auto const& at, ssize_t n, int start, int size) {
+      auto indices = std::vector<ssize_t>(size, -1);
+      auto const& flip = at(n) < at(0);
+      // Walk the cell boundaries in increasing order.
+      auto const& bound = [&](ssize_t k) { return flip ? at(n - k) : at(k); };
+      auto k = ssize_t{0};
+      for (auto u = 0; u < size; ++u) {
+        auto const& center = start + u + .5;
+        for (; k < n && bound(k + 1) <= center; ++k) {}
+        if (bound(0) <= center && k < n) {
+          indices[u] = flip ? n - 1 - k : k;
+        }
+      }
+      return indices;
+    };
+  auto const& cols = cell_indices(xs, mesh_width, left, width),
+            & rows = cell_indices(ys, mesh_height, top, height);
+  auto const& premultiplied_argb32 = [&](ssize_t n) {
+    auto const& a = fcs(n, 3);
+    auto const& channel = [](double c) {  // As cairo does for solid colors.
+      return uint32_t(uint16_t(std::clamp(c, 0., 1.) * 0xffff + .5) >> 8);
+    };
+    return (channel(a) << 24) + (channel(fcs(n, 0) * a) << 16)
+           + (channel(fcs(n, 1) * a) << 8) + (channel(fcs(n, 2) * a) << 0);
+  };
+  auto const& surface =
+    cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  auto const& data = cairo_image_surface_get_data(surface);
+  auto const& stride = cairo_image_surface_get_stride(surface);
+  cairo_surface_flush(surface);
+  maybe_parallel_for(height, width, [&](ssize_t start, ssize_t stop) {
+    // Cell colors of the last cell row used by this chunk.
+    auto row_colors = std::vector<uint32_t>(mesh_width);
+    auto row_colors_index = ssize_t{-1};
+    for (auto v = start; v < stop; ++v) {
+      auto const& dst = reinterpret_cast<uint32_t*>(data + v * stride);
+      auto const& i = rows[v];
+      if (i < 0) {
+        std::fill(dst, dst + width, 0);
+        continue;
+      }
+      if (i != row_colors_index) {
+        for (auto j = 0; j < mesh_width; ++j) {
+          row_colors[j] = premultiplied_argb32(i * mesh_width + j);
+        }
+        row_colors_index = i;
+      }
+      for (auto u = 0; u < width; ++u) {
+        dst[u] = cols[u] < 0 ? 0 : row_colors[cols[u]];
+      }
+    }
+  });
+  cairo_surface_mark_dirty(surface);
+  cairo_save(cr);
+  cairo_set_source_surface(cr, surface, left, top);
+  cairo_surface_destroy(surface);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+  cairo_paint(cr);
+  cairo_restore(cr);
+  return true;
+}
+
+// Fill the cells of a quad mesh one at a time, skipping those outside the
+// clip.  On image surfaces, with collection_threads set, the target is split
+// into row bands that are filled in parallel, each by its own context drawing
+// directly into the target's buffer; as each pixel is only touched by one
+// band, the result is identical to a serial fill.  Must be called without the
+// GIL.
+template<typename C, typename F>
+void fill_quads(
+  cairo_t* cr, ssize_t mesh_width, ssize_t mesh_height,
+  C const& coords, F const& fcs, bool clipped)
+{
+  auto const& fill = [&](cairo_t* ctx) {
+    auto cx0 = 0., cy0 = 0., cx1 = 0., cy1 = 0.;
+    cairo_clip_extents(ctx, &cx0, &cy0, &cx1, &cy1);
+    for (auto i = 0; i < mesh_height; ++i) {
+      for (auto j = 0; j < mesh_width; ++j) {
+        auto const& [x0, x1] = std::minmax({
+          coords(i, j, 0), coords(i, j + 1, 0),
+          coords(i + 1, j + 1, 0), coords(i + 1, j, 0)});
+        auto const& [y0, y1] = std::minmax({
+          coords(i, j, 1), coords(i, j + 1, 1),
+          coords(i + 1, j + 1, 1), coords(i + 1, j, 1)});
+        if (x1 < cx0 || x0 > cx1 || y1 < cy0 || y0 > cy1) {
+          continue;
+        }
+        cairo_move_to(ctx, coords(i, j, 0), coords(i, j, 1));
+        cairo_line_to(ctx, coords(i, j + 1, 0), coords(i, j + 1, 1));
+        cairo_line_to(ctx, coords(i + 1, j + 1, 0), coords(i + 1, j + 1, 1));
+        cairo_line_to(ctx, coords(i + 1, j, 0), coords(i + 1, j, 1));
+        cairo_close_path(ctx);
+        auto const& n = i * mesh_width + j;
+        cairo_set_source_rgba(
+          ctx, fcs(n, 0), fcs(n, 1), fcs(n, 2), fcs(n, 3));
+        cairo_fill(ctx);
+      }
+    }
+  };
+  auto const& target = cairo_get_group_target(cr);
+  auto sx = 1., sy = 1.;
+  if (detail::cairo_surface_get_device_scale) {
+    detail::cairo_surface_get_device_scale(target, &sx, &sy);
+  }
+  auto const& clip = cairo_copy_clip_rectangle_list(cr);
+  // An unclipped context also reports a non-representable clip, hence the
+  // need for the caller to tell whether it set a clip.
+  auto const& unclipped =
+    clip->status == CAIRO_STATUS_CLIP_NOT_REPRESENTABLE && !clipped;
+  if (detail::COLLECTION_THREADS > 1
+      && cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE
+      && sx == 1 && sy == 1
+      && (clip->status == CAIRO_STATUS_SUCCESS || unclipped)) {
+    auto const& data = cairo_image_surface_get_data(target);
+    auto const& format = cairo_image_surface_get_format(target);
+    auto const& width = cairo_image_surface_get_width(target),
+              & height = cairo_image_surface_get_height(target),
+              & stride = cairo_image_surface_get_stride(target);
+    auto ox = 0., oy = 0.;
+    cairo_surface_get_device_offset(target, &ox, &oy);
+    auto matrix = cairo_matrix_t{};
+    cairo_get_matrix(cr, &matrix);
+    auto const& antialias = cairo_get_antialias(cr);
+    auto const& op = cairo_get_operator(cr);
+    cairo_surface_flush(target);
+    ThreadPool::get().parallel_for(
+      height, detail::COLLECTION_THREADS, [&](size_t start, size_t stop) {
+        auto const& band = cairo_image_surface_create_for_data(
+          data + start * stride, format, width, stop - start, stride);
+        cairo_surface_set_device_offset(band, ox, oy - start);
+        auto const& ctx = cairo_create(band);
+        cairo_surface_destroy(band);
+        cairo_set_matrix(ctx, &matrix);
+        if (!unclipped) {
+          for (auto k = 0; k < clip->num_rectangles; ++k) {
+            auto const& rect = clip->rectangles[k];
+            cairo_rectangle(ctx, rect.x, rect.y, rect.width, rect.height);
+          }
+          cairo_clip(ctx);
+        }
+        cairo_set_antialias(ctx, antialias);
+        cairo_set_operator(ctx, op);
+        fill(ctx);
+        cairo_destroy(ctx);
+      });
+    cairo_surface_mark_dirty(target);
+  } else {
+    fill(cr);
+  }
+  cairo_rectangle_list_destroy(clip);
+}
+
 // While draw_quad_mesh is technically optional, the fallback is to use
 // draw_path_collection, which creates artefacts at the junctions due to
 // stamping.
@@ -1423,7 +2230,8 @@ void GraphicsContextRenderer::draw_quad_mesh(
   GraphicsContextRenderer& gc,
   py::object master_transform,
   ssize_t mesh_width, ssize_t mesh_height,
-  py::array_t<double> coordinates,
+  std::variant<py::array_t<double, py::array::c_style | py::array::forcecast>,
+               py::array_t<float, py::array::c_style>> coordinates,
   py::array_t<double> offsets,
   py::object offset_transform,
   py::array_t<double> fcs,
@@ -1436,22 +2244,25 @@ void GraphicsContextRenderer::draw_quad_mesh(
   auto const& ac = _additional_context();
   auto mtx =
     matrix_from_transform(master_transform, get_additional_state().height);
+  auto const& coords_array =
+    std::visit([](auto const& a) -> py::array { return a; }, coordinates);
   auto const& fcs_raw = fcs.unchecked<2>(),
             & ecs_raw = ecs.unchecked<2>();
-  if (coordinates.shape(0) != mesh_height + 1
-      || coordinates.shape(1) != mesh_width + 1
-      || coordinates.shape(2) != 2
+  if (coords_array.ndim() != 3
+      || coords_array.shape(0) != mesh_height + 1
+      || coords_array.shape(1) != mesh_width + 1
+      || coords_array.shape(2) != 2
       || fcs_raw.shape(0) != mesh_height * mesh_width
       || fcs_raw.shape(1) != 4
       || ecs_raw.shape(1) != 4) {
     throw std::invalid_argument{
       "shapes of coordinates {.shape}, facecolors {.shape}, and "
-      "edgecolors {.shape} do not match"_format(coordinates, fcs, ecs)
+      "edgecolors {.shape} do not match"_format(coords_array, fcs, ecs)
       .cast<std::string>()};
   }
   if (offsets.ndim() != 2 || offsets.shape(0) != 1 || offsets.shape(1) != 2) {
     renderer_base("draw_quad_mesh")(
-      this, master_transform, mesh_height, mesh_width, coordinates,
+      this, master_transform, mesh_height, mesh_width, coords_array,
       offsets, offset_transform, fcs, aas, ecs);
     return;
   }
@@ -1459,23 +2270,73 @@ void GraphicsContextRenderer::draw_quad_mesh(
     offset_transform.attr("transform")(offsets).cast<py::array_t<double>>();
   mtx.x0 += tr_offset.at(0, 0),
   mtx.y0 -= tr_offset.at(0, 1);
-  auto coords_raw_keepref =  // Let numpy manage the buffer.
-    coordinates.attr("copy")().cast<py::array_t<double>>();
-  auto coords_raw = coords_raw_keepref.mutable_unchecked<3>();
-  for (auto i = 0; i < mesh_height + 1; ++i) {
-    for (auto j = 0; j < mesh_width + 1; ++j) {
-      cairo_matrix_transform_point(
-        &mtx,
-        coords_raw.mutable_data(i, j, 0), coords_raw.mutable_data(i, j, 1));
-    }
-  }
-  // If edge colors are set, we need to draw the quads one at a time in
-  // order to be able to draw the edges as well.  If they are not set, using
-  // cairo's mesh pattern support instead avoids conflation artefacts.
+  auto const& state = get_additional_state();
+  auto const& vector = has_vector_surface(cr_);
+  auto const& clipped =
+    state.clip_rectangle || std::get<1>(state.clip_path);
+  auto const& nogil = py::gil_scoped_release{};
+  // The transformed coordinates go to a per-thread buffer, which is reused
+  // across calls, except for meshes above 8 MiB of coordinates, for which the
+  // allocation cost is negligible anyway: these get their own buffer, so that
+  // a single huge mesh does not pin its memory for the thread's lifetime.
+  // (Lambdas running on pool threads must only access the buffer via the
+  // local pointer, not via the thread_local.)
+  thread_local auto reused_buf = std::vector<double>{};
+  auto own_buf = std::vector<double>{};
+  auto const& row_size = 2 * (mesh_width + 1);
+  auto const& n_coords = size_t(row_size * (mesh_height + 1));
+  auto& buf = n_coords <= (1 << 20) ? reused_buf : own_buf;
+  buf.resize(n_coords);
+  auto const& dst = buf.data();
+  std::visit([&](auto const& a) {
+    auto const& src = a.data();
+    maybe_parallel_for(
+      mesh_height + 1, mesh_width + 1, [&](ssize_t start, ssize_t stop) {
+        transform_points(
+          mtx, src + start * row_size, dst + start * row_size,
+          (stop - start) * (mesh_width + 1));
+      });
+  }, coordinates);
+  auto const& coords_raw = [&](ssize_t i, ssize_t j, int k) {
+    return dst[i * row_size + 2 * j + k];
+  };
+  // If edge colors are uniform, fill all the quads first, then stroke all
+  // the edges at once, as grid lines.  Otherwise, we need to draw the quads
+  // one at a time in order to be able to draw the edges as well.  If they are
+  // not set, using cairo's mesh pattern support instead avoids conflation
+  // artefacts.
   // (FIXME[matplotlib]: In fact, it may make sense to rewrite hexbin in terms
   // of quadmeshes in order to fix their long-standing issues with such
   // artefacts.)
-  if (ecs_raw.shape(0)) {
+  auto uniform_edges = ecs_raw.shape(0) > 0;
+  for (auto n = 1; uniform_edges && n < ecs_raw.shape(0); ++n) {
+    for (auto k = 0; k < 4; ++k) {
+      uniform_edges &= ecs_raw(n, k) == ecs_raw(0, k);
+    }
+  }
+  if (uniform_edges) {
+    if (vector
+        || !draw_rectilinear_quad_mesh(
+             cr_, mesh_width, mesh_height, coords_raw, fcs_raw)) {
+      fill_quads(
+        cr_, mesh_width, mesh_height, coords_raw, fcs_raw, clipped);
+    }
+    for (auto i = 0; i < mesh_height + 1; ++i) {
+      cairo_move_to(cr_, coords_raw(i, 0, 0), coords_raw(i, 0, 1));
+      for (auto j = 1; j < mesh_width + 1; ++j) {
+        cairo_line_to(cr_, coords_raw(i, j, 0), coords_raw(i, j, 1));
+      }
+    }
+    for (auto j = 0; j < mesh_width + 1; ++j) {
+      cairo_move_to(cr_, coords_raw(0, j, 0), coords_raw(0, j, 1));
+      for (auto i = 1; i < mesh_height + 1; ++i) {
+        cairo_line_to(cr_, coords_raw(i, j, 0), coords_raw(i, j, 1));
+      }
+    }
+    cairo_set_source_rgba(
+      cr_, ecs_raw(0, 0), ecs_raw(0, 1), ecs_raw(0, 2), ecs_raw(0, 3));
+    cairo_stroke(cr_);
+  } else if (ecs_raw.shape(0)) {
     for (auto i = 0; i < mesh_height; ++i) {
       for (auto j = 0; j < mesh_width; ++j) {
         cairo_move_to(
@@ -1497,6 +2358,10 @@ void GraphicsContextRenderer::draw_quad_mesh(
         cairo_stroke(cr_);
       }
     }
+  } else if (!vector
+             && draw_rectilinear_quad_mesh(
+                  cr_, mesh_width, mesh_height, coords_raw, fcs_raw)) {
+    // Drawn as an image, which is much faster for large meshes.
   } else {
     auto const& pattern = cairo_pattern_create_mesh();
     for (auto i = 0; i < mesh_height; ++i) {
@@ -1597,6 +2462,7 @@ void GraphicsContextRenderer::draw_text(
     cairo_translate(cr_, x, y);
     cairo_rotate(cr_, -angle * std::acos(-1) / 180);
     cairo_move_to(cr_, 0, 0);
+    auto const& nogil = py::gil_scoped_release{};
     cairo_show_text_glyphs(
       cr_, s.c_str(), s.size(),
       gac.glyphs, gac.num_glyphs,
@@ -1638,28 +2504,215 @@ GraphicsContextRenderer::get_text_width_height_descent(
   }
 }
 
-void GraphicsContextRenderer::start_filter()
+// Return the (left, top, right, bottom) bounds of the drawn (i.e., not fully
+// transparent) region of a cairo ARGB32 or RGBA128F buffer, whose rows are
+// *stride* elements apart; top == bottom if nothing is drawn.
+template<typename T>
+std::tuple<ssize_t, ssize_t, ssize_t, ssize_t> find_drawn_bounds(
+  T const* data, ssize_t width, ssize_t height, ssize_t stride)
+{
+  auto const& row = [&](ssize_t i) { return data + stride * i; };
+  auto const& first_drawn = [](T const* src, ssize_t n) {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      return ssize_t(pixel::argb32_first_drawn(src, n));
+    } else {
+      return ssize_t(pixel::rgba128f_first_drawn(src, n));
+    }
+  };
+  auto const& end_drawn = [](T const* src, ssize_t n) {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      return ssize_t(pixel::argb32_end_drawn(src, n));
+    } else {
+      return ssize_t(pixel::rgba128f_end_drawn(src, n));
+    }
+  };
+  // Find the first and last drawn rows, then only scan the parts of the rows
+  // in between that lie outside of the bounds found so far.
+  auto top = ssize_t{0}, bottom = height, left = width, right = ssize_t{0};
+  for (; top < height && first_drawn(row(top), width) == width; ++top) {}
+  for (; bottom > top && first_drawn(row(bottom - 1), width) == width;
+       --bottom) {}
+  for (auto i = top; i < bottom; ++i) {
+    left = first_drawn(row(i), left);
+    right += end_drawn(row(i) + 4 * right, width - right);
+  }
+  return {left, top, right, bottom};
+}
+
+// Return the (x0, y0, x1, y1) extents of what has been drawn on a group
+// surface, in the surface's backend coordinates (i.e., pixels for image
+// surfaces), or nullopt if they cannot be determined.
+std::optional<std::tuple<double, double, double, double>>
+group_ink_extents(cairo_surface_t* surface)
 {
+  switch (cairo_surface_get_type(surface)) {
+    case CAIRO_SURFACE_TYPE_RECORDING: {
+      auto x = 0., y = 0., w = 0., h = 0.;
+      cairo_recording_surface_ink_extents(surface, &x, &y, &w, &h);
+      return {{x, y, x + w, y + h}};
+    }
+    case CAIRO_SURFACE_TYPE_IMAGE: {
+      cairo_surface_flush(surface);
+      auto const& data = cairo_image_surface_get_data(surface);
+      auto const& width = cairo_image_surface_get_width(surface),
+                & height = cairo_image_surface_get_height(surface),
+                & stride = cairo_image_surface_get_stride(surface);
+      auto left = ssize_t{}, top = ssize_t{}, right = ssize_t{},
+           bottom = ssize_t{};
+      switch (static_cast<int>(cairo_image_surface_get_format(surface))) {
+        case static_cast<int>(CAIRO_FORMAT_ARGB32):
+          std::tie(left, top, right, bottom) =
+            find_drawn_bounds(data, width, height, stride);
+          break;
+        case 7:  // CAIRO_FORMAT_RGBA_128F.
+          std::tie(left, top, right, bottom) =
+            find_drawn_bounds(
+              reinterpret_cast<float const*>(data), width, height,
+              stride / ssize_t(sizeof(float)));
+          break;
+        default:
+          return {};
+      }
+      return {{double(left), double(top), double(right), double(bottom)}};
+    }
+    default:
+      return {};
+  }
+}
+
+void GraphicsContextRenderer::start_filter(std::optional<py::object> bbox)
+{
+  // Clipping to the hint bounds the group, which cairo sizes to the clip
+  // extents; the outer save is undone by _stop_filter_get_buffer.
+  cairo_save(cr_);
+  if (bbox) {
+    auto const& height = get_additional_state().height;
+    auto const& x0 = std::floor(bbox->attr("x0").cast<double>()),
+              & x1 = std::ceil(bbox->attr("x1").cast<double>()),
+              // Invert y-axis.
+              & y0 = std::floor(height - bbox->attr("y1").cast<double>()),
+              & y1 = std::ceil(height - bbox->attr("y0").cast<double>());
+    cairo_new_path(cr_);
+    cairo_rectangle(cr_, x0, y0, x1 - x0, y1 - y0);
+    cairo_clip(cr_);
+  }
   cairo_push_group(cr_);
   new_gc();
 }
 
-py::array GraphicsContextRenderer::_stop_filter_get_buffer()
+// Pop the group pushed by start_filter, and rasterize it, at *scale* device
+// pixels per user unit, into a new image surface (owned by the caller) that
+// only covers its drawn extents, whose offset (in device pixels) is returned
+// as well.
+std::tuple<cairo_surface_t*, int, int>
+GraphicsContextRenderer::pop_group_to_image(double scale)
 {
   restore();
-  auto const& pattern = cairo_pop_group(cr_);
   auto const& state = get_additional_state();
+  // Bound the output by the canvas, the clip, and (if known) the extents of
+  // what was actually drawn in the group, all in user space.
+  auto x0 = 0., y0 = 0., x1 = state.width, y1 = state.height;
+  auto const& intersect = [&](double a0, double b0, double a1, double b1) {
+    x0 = std::max(x0, a0); y0 = std::max(y0, b0);
+    x1 = std::min(x1, a1); y1 = std::min(y1, b1);
+  };
+  {
+    auto cx0 = 0., cy0 = 0., cx1 = 0., cy1 = 0.;
+    cairo_clip_extents(cr_, &cx0, &cy0, &cx1, &cy1);
+    intersect(cx0, cy0, cx1, cy1);
+  }
+  auto const& group = cairo_get_group_target(cr_);
+  if (auto const& ink = group_ink_extents(group)) {
+    auto const& [ix0, iy0, ix1, iy1] = *ink;
+    if (ix0 < ix1 && iy0 < iy1) {
+      // Backend to device coordinates, then device to user.
+      auto ox = 0., oy = 0., sx = 1., sy = 1.;
+      cairo_surface_get_device_offset(group, &ox, &oy);
+      if (detail::cairo_surface_get_device_scale) {
+        detail::cairo_surface_get_device_scale(group, &sx, &sy);
+      }
+      auto ux0 = INFINITY, uy0 = INFINITY, ux1 = -INFINITY, uy1 = -INFINITY;
+      for (auto const& [bx, by]: {std::pair{ix0, iy0}, std::pair{ix1, iy0},
+                                  std::pair{ix0, iy1}, std::pair{ix1, iy1}}) {
+        auto x = (bx - ox) / sx, y = (by - oy) / sy;
+        cairo_device_to_user(cr_, &x, &y);
+        ux0 = std::min(ux0, x); uy0 = std::min(uy0, y);
+        ux1 = std::max(ux1, x); uy1 = std::max(uy1, y);
+      }
+      intersect(ux0, uy0, ux1, uy1);
+    } else {
+      x1 = x0; y1 = y0;
+    }
+  }
+  auto const& pattern = cairo_pop_group(cr_);
+  cairo_restore(cr_);
+  auto const& left = int(std::floor(scale * x0)),
+            & top = int(std::floor(scale * y0));
+  auto const width = std::max(int(std::ceil(scale * x1)) - left, 0),
+             height = std::max(int(std::ceil(scale * y1)) - top, 0);
   auto const& raster_surface =
-    cairo_image_surface_create(
-      get_cairo_format(), int(state.width), int(state.height));
+    cairo_image_surface_create(get_cairo_format(), width, height);
   auto const& raster_cr = cairo_create(raster_surface);
+  cairo_translate(raster_cr, -left, -top);
+  cairo_scale(raster_cr, scale, scale);
   cairo_set_source(raster_cr, pattern);
   cairo_pattern_destroy(pattern);
-  cairo_paint(raster_cr);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    cairo_paint(raster_cr);
+  }
   cairo_destroy(raster_cr);
+  return {raster_surface, left, top};
+}
+
+std::tuple<py::array, std::tuple<int, int>>
+GraphicsContextRenderer::_stop_filter_get_buffer()
+{
+  auto const& [raster_surface, left, top] = pop_group_to_image(1);
   auto const& buffer = image_surface_to_buffer(raster_surface);
   cairo_surface_destroy(raster_surface);
-  return buffer;
+  return {buffer, {left, top}};
+}
+
+void GraphicsContextRenderer::start_rasterizing()
+{
+  start_filter();
+}
+
+void GraphicsContextRenderer::stop_rasterizing()
+{
+  if (!has_vector_surface(cr_)) {  // Just composite the group back.
+    restore();
+    cairo_pop_group_to_source(cr_);
+    {
+      auto const& nogil = py::gil_scoped_release{};
+      cairo_paint(cr_);
+    }
+    cairo_restore(cr_);
+    return;
+  }
+  // Rasterize at the fallback resolution (i.e., the savefig dpi), rather than
+  // at the (72 dpi) resolution of the vector canvas.
+  auto x_res = 0., y_res = 0.;
+  cairo_surface_get_fallback_resolution(cairo_get_target(cr_), &x_res, &y_res);
+  auto const& scale = x_res / get_additional_state().dpi;
+  auto const& [raster_surface, left, top] = pop_group_to_image(scale);
+  if (!cairo_image_surface_get_width(raster_surface)
+      || !cairo_image_surface_get_height(raster_surface)) {
+    cairo_surface_destroy(raster_surface);
+    return;
+  }
+  auto const& pattern = cairo_pattern_create_for_surface(raster_surface);
+  cairo_surface_destroy(raster_surface);
+  auto const& mtx =
+    cairo_matrix_t{scale, 0, 0, scale, double(-left), double(-top)};
+  cairo_pattern_set_matrix(pattern, &mtx);
+  cairo_set_source(cr_, pattern);
+  cairo_pattern_destroy(pattern);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    cairo_paint(cr_);
+  }
 }
 
 Region GraphicsContextRenderer::copy_from_bbox(py::object bbox)
@@ -1766,12 +2819,57 @@ void MathtextBackend::add_usetex_glyph(
     filename, size, codepoint_or_name_or_index, ox, oy, slant, extend);
 }
 
+void MathtextBackend::add_usetex_glyphs(
+  py::array_t<double> ox, py::array_t<double> oy,
+  std::vector<std::string> filenames, py::array_t<double> sizes,
+  std::vector<std::variant<std::string, FT_ULong>> names_or_indices,
+  py::array_t<double> slants, py::array_t<double> extends)
+{
+  auto const& ox_raw = ox.unchecked<1>(), oy_raw = oy.unchecked<1>(),
+            & sizes_raw = sizes.unchecked<1>(),
+            & slants_raw = slants.unchecked<1>(),
+            & extends_raw = extends.unchecked<1>();
+  auto const& n = ox_raw.shape(0);
+  if (oy_raw.shape(0) != n
+      || ssize_t(filenames.size()) != n || sizes_raw.shape(0) != n
+      || ssize_t(names_or_indices.size()) != n
+      || slants_raw.shape(0) != n || extends_raw.shape(0) != n) {
+    throw std::invalid_argument{"mismatched lengths of glyph specs"};
+  }
+  glyphs_.reserve(glyphs_.size() + n);
+  for (auto i = 0; i < n; ++i) {
+    auto codepoint_or_name_or_index =
+      std::variant<char32_t, std::string, FT_ULong>{};
+    std::visit(
+      [&](auto name_or_index) { codepoint_or_name_or_index = name_or_index; },
+      std::move(names_or_indices[i]));
+    glyphs_.emplace_back(
+      std::move(filenames[i]), sizes_raw(i), codepoint_or_name_or_index,
+      ox_raw(i), oy_raw(i), slants_raw(i), extends_raw(i));
+  }
+}
+
 void MathtextBackend::add_rect(
   double x1, double y1, double x2, double y2)
 {
   rectangles_.emplace_back(x1, y1, x2 - x1, y2 - y1);
 }
 
+void MathtextBackend::add_rects(py::array_t<double> rects)
+{
+  auto const& rects_raw = rects.unchecked<2>();
+  if (rects_raw.shape(1) != 4) {
+    throw std::invalid_argument{
+      "rects must have shape (n, 4), not {.shape}"_format(rects)
+      .cast<std::string>()};
+  }
+  auto const& n = rects_raw.shape(0);
+  rectangles_.reserve(rectangles_.size() + n);
+  for (auto i = 0; i < n; ++i) {
+    add_rect(rects_raw(i, 0), rects_raw(i, 1), rects_raw(i, 2), rects_raw(i, 3));
+  }
+}
+
 void MathtextBackend::draw(
   GraphicsContextRenderer& gcr, double x, double y, double angle) const
 {
@@ -1794,10 +2892,22 @@ void MathtextBackend::draw(
       size * glyph.extend, 0, -size * glyph.slant * glyph.extend, size, 0, 0};
     cairo_set_font_matrix(cr, &mtx);
     adjust_font_options(cr);
-    auto ft_face =
-      static_cast<FT_Face>(
-        cairo_font_face_get_user_data(font_face, &detail::FT_KEY));
+    // The face is shared with other threads (through FONT_CACHE), and its
+    // charmap is changed below, so lock it for the duration of the lookup.
+    auto const& scaled_font = cairo_get_scaled_font(cr);
+    auto const& ft_face = cairo_ft_scaled_font_lock_face(scaled_font);
+    if (!ft_face) {
+      CAIRO_CHECK(cairo_scaled_font_status, scaled_font);
+      throw std::runtime_error{"failed to lock font face"};
+    }
+    auto scaled_font_unlock_cleanup =
+      std::unique_ptr<
+        std::remove_pointer_t<cairo_scaled_font_t>,
+        decltype(&cairo_ft_scaled_font_unlock_face)>{
+          scaled_font, cairo_ft_scaled_font_unlock_face};
     auto index = FT_UInt{};
+    // Warnings run Python code, and thus are only emitted after unlocking.
+    auto missing = std::optional<std::string>{};
     std::visit(overloaded {
       [&](char32_t codepoint) {
         // The last unicode charmap is the FreeType-synthesized one.
@@ -1813,13 +2923,13 @@ void MathtextBackend::draw(
         }
         index = FT_Get_Char_Index(ft_face, codepoint);
         if (!index) {
-          warn_on_missing_glyph("#" + std::to_string(index));
+          missing = "#" + std::to_string(index);
         }
       },
       [&](std::string name) {
         index = FT_Get_Name_Index(ft_face, name.data());
         if (!index) {
-          warn_on_missing_glyph(name);
+          missing = name;
         }
       },
       [&](FT_ULong idx) {
@@ -1842,10 +2952,15 @@ void MathtextBackend::draw(
         }
         index = FT_Get_Char_Index(ft_face, idx);
         if (!index) {
-          warn_on_missing_glyph("#" + std::to_string(index));
+          missing = "#" + std::to_string(index);
         }
       }
     }, glyph.codepoint_or_name_or_index);
+    // cairo locks the face itself (non-reentrantly) when rendering.
+    scaled_font_unlock_cleanup.reset();
+    if (missing) {
+      warn_on_missing_glyph(*missing);
+    }
     auto const& raw_glyph = cairo_glyph_t{index, glyph.x, glyph.y};
     cairo_show_glyphs(cr, &raw_glyph, 1);
   }
@@ -1855,81 +2970,213 @@ void MathtextBackend::draw(
   }
 }
 
-py::array_t<uint8_t, py::array::c_style> cairo_to_premultiplied_argb32(
+// The destination of a pixel format conversion: a uint8 array with the same
+// shape as the source, viewed as n_rows rows of row_size pixels; pixels are
+// contiguous within each row, but rows may be strided.
+struct ConversionOutput {
+  py::array array;
+  uint8_t* data;
+  ssize_t n_rows, row_size, stride;
+};
+
+ConversionOutput get_conversion_output(
+  py::array const& buf, std::optional<py::array> out)
+{
+  auto const& ndim = buf.ndim();
+  if (!ndim || buf.shape(ndim - 1) != 4) {
+    throw std::invalid_argument{
+      "buffer must have shape (..., 4), not {.shape}"_format(buf)
+      .cast<std::string>()};
+  }
+  if (!out) {
+    out = py::array_t<uint8_t, py::array::c_style>{
+      std::vector<ssize_t>(buf.shape(), buf.shape() + ndim)};
+  }
+  if (!py::isinstance<py::array_t<uint8_t>>(*out) || !out->writeable()) {
+    throw std::invalid_argument{"out must be a writeable uint8 array"};
+  }
+  if (!std::equal(buf.shape(), buf.shape() + ndim,
+                  out->shape(), out->shape() + out->ndim())) {
+    throw std::invalid_argument{
+      "out must have the same shape as the buffer ({.shape}), not "
+      "{.shape}"_format(buf, *out).cast<std::string>()};
+  }
+  auto dst = ConversionOutput{
+    *out, static_cast<uint8_t*>(out->mutable_data()),
+    1, buf.size() / 4, 4 * (buf.size() / 4)};
+  // Rows must not overlap each other.
+  if (ndim == 3
+      && out->strides(2) == 1 && out->strides(1) == 4
+      && out->strides(0) >= 4 * buf.shape(1)) {
+    dst.n_rows = buf.shape(0);
+    dst.row_size = buf.shape(1);
+    dst.stride = out->strides(0);
+  } else if (!(out->flags() & py::array::c_style)) {
+    throw std::invalid_argument{
+      "out must either be C-contiguous, or have shape (m, n, 4) and strides "
+      "(s, 4, 1) with s >= 4 * n"};
+  }
+  // Converting in place is supported, but not partial overlaps.
+  auto const& src_begin = static_cast<uint8_t const*>(buf.data()),
+              src_end = src_begin + buf.nbytes();
+  auto const& dst_begin = dst.data,
+              dst_end =
+                dst_begin + (dst.n_rows - 1) * dst.stride + 4 * dst.row_size;
+  if (dst_begin < src_end && src_begin < dst_end
+      && !(dst_begin == src_begin && dst.stride == 4 * dst.row_size
+           && buf.itemsize() == 1)) {
+    throw std::invalid_argument{
+      "out must either be the buffer itself, or not overlap with it"};
+  }
+  return dst;
+}
+
+// Call convert_row(i, row) on each row of dst, possibly in parallel, releasing
+// the GIL.
+template<typename F>
+void convert_rows(ConversionOutput const& dst, F convert_row)
+{
+  auto const& nogil = py::gil_scoped_release{};
+  maybe_parallel_for(
+    dst.n_rows, dst.row_size, [&](ssize_t start, ssize_t stop) {
+      for (auto i = start; i < stop; ++i) {
+        convert_row(i, dst.data + i * dst.stride);
+      }
+    });
+}
+
+py::array cairo_to_premultiplied_argb32(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
-               py::array_t<float, py::array::c_style>> buf)
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out)
 {
   return std::visit(overloaded {
-    [](py::array_t<uint8_t, py::array::c_style> buf) {
-      return buf;
-    },
-    [](py::array_t<float, py::array::c_style> buf) {
-      auto f32_ptr = buf.data(0);
-      auto const& size = buf.size();
-      auto u8 = py::array_t<uint8_t, py::array::c_style>{buf.request().shape};
-      auto u32_ptr = reinterpret_cast<uint32_t*>(u8.mutable_data(0));
-      for (auto i = 0; i < size; i += 4) {
-        auto const& r = *f32_ptr++, g = *f32_ptr++, b = *f32_ptr++, a = *f32_ptr++;
-        *u32_ptr++ =
-          (uint32_t(uint8_t(a * 0xff)) << 24)
-          + (uint32_t(uint8_t(r * 0xff)) << 16)
-          + (uint32_t(uint8_t(g * 0xff)) << 8)
-          + (uint32_t(uint8_t(b * 0xff)) << 0);
+    [&](py::array_t<uint8_t, py::array::c_style> buf) -> py::array {
+      if (!out) {
+        return buf;
       }
-      return u8;
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        auto const& src_row = src + 4 * dst.row_size * i;
+        if (row != src_row) {  // Nothing to do if in place.
+          std::memcpy(row, src_row, 4 * dst.row_size);
+        }
+      });
+      return dst.array;
+    },
+    [&](py::array_t<float, py::array::c_style> buf) -> py::array {
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        pixel::rgba128f_to_argb32(
+          src + 4 * dst.row_size * i, row, dst.row_size);
+      });
+      return dst.array;
     }
   },
   buf);
 }
 
-py::array_t<uint8_t, py::array::c_style> cairo_to_premultiplied_rgba8888(
+py::array cairo_to_premultiplied_rgba8888(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
-               py::array_t<float, py::array::c_style>> buf)
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out)
 {
-  auto u8 = std::visit(overloaded {
-    [](py::array_t<uint8_t, py::array::c_style> buf) {
-      return
-        buf.attr("copy")().cast<py::array_t<uint8_t, py::array::c_style>>();
-    },
-    [](py::array_t<float, py::array::c_style> buf) {
-      return cairo_to_premultiplied_argb32(buf);
+  return std::visit(overloaded {
+    [&](py::array_t<uint8_t, py::array::c_style> buf) -> py::array {
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        pixel::argb32_to_premultiplied_rgba8888(
+          src + 4 * dst.row_size * i, row, dst.row_size);
+      });
+      return dst.array;
     },
-  }, buf);
-  auto const& size = u8.size();
-  // Much faster than `np.take(..., [2, 1, 0, 3] / [1, 2, 3, 0], axis=2)`.
-  if (*reinterpret_cast<uint16_t const*>("\0\xff") > 0x100) {  // little-endian
-    uint8_t* u8_ptr = u8.mutable_data();
-    for (auto i = 0; i < size; i += 4) {
-      std::swap(u8_ptr[i], u8_ptr[i + 2]);  // BGRA->RGBA
+    [&](py::array_t<float, py::array::c_style> buf) -> py::array {
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        pixel::rgba128f_to_argb32(
+          src + 4 * dst.row_size * i, row, dst.row_size);
+        pixel::argb32_to_premultiplied_rgba8888(row, row, dst.row_size);
+      });
+      return dst.array;
     }
-  } else {  // big-endian
-    auto u32_ptr = reinterpret_cast<uint32_t*>(u8.mutable_data());
-    for (auto i = 0; i < size / 4; i++) {
-      u32_ptr[i] = (u32_ptr[i] << 8) + (u32_ptr[i] >> 24);  // ARGB->RGBA
+  },
+  buf);
+}
+
+py::array cairo_to_straight_rgba8888(
+  std::variant<py::array_t<uint8_t, py::array::c_style>,
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out)
+{
+  return std::visit(overloaded {
+    [&](py::array_t<uint8_t, py::array::c_style> buf) -> py::array {
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        pixel::argb32_to_straight_rgba8888(
+          src + 4 * dst.row_size * i, row, dst.row_size);
+      });
+      return dst.array;
+    },
+    [&](py::array_t<float, py::array::c_style> buf) -> py::array {
+      auto const& dst = get_conversion_output(buf, out);
+      auto const& src = buf.data();
+      convert_rows(dst, [&](ssize_t i, uint8_t* row) {
+        pixel::rgba128f_to_argb32(
+          src + 4 * dst.row_size * i, row, dst.row_size);
+        pixel::argb32_to_straight_rgba8888(row, row, dst.row_size);
+      });
+      return dst.array;
     }
-  }
-  return u8;
+  },
+  buf);
 }
 
-py::array_t<uint8_t, py::array::c_style> cairo_to_straight_rgba8888(
+std::tuple<py::array, std::tuple<ssize_t, ssize_t, ssize_t, ssize_t>>
+get_drawn_subarray_and_bounds(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
                py::array_t<float, py::array::c_style>> buf)
 {
-  auto rgba = cairo_to_premultiplied_rgba8888(buf);
-  auto u8_ptr = rgba.mutable_data(0);
-  auto const& size = rgba.size();
-  for (auto i = 0; i < size; i += 4) {
-    auto r = u8_ptr++, g = u8_ptr++, b = u8_ptr++, a = u8_ptr++;
-    if (*a != 0xff) {
-      // Relying on a precomputed table yields a ~2x speedup, but avoiding the
-      // table lookup in the opaque case is still faster.
-      auto subtable = &detail::unpremultiplication_table[*a << 8];
-      *r = subtable[*r];
-      *g = subtable[*g];
-      *b = subtable[*b];
+  return std::visit([&](auto const& buf) {
+    using T = typename std::decay_t<decltype(buf)>::value_type;
+    if (buf.ndim() != 3 || buf.shape(2) != 4) {
+      throw std::invalid_argument{
+        "buffer must have shape (height, width, 4), not {.shape}"_format(buf)
+        .cast<std::string>()};
     }
-  }
-  return rgba;
+    auto const& width = buf.shape(1);
+    auto const& row = [&](ssize_t i) { return buf.data() + 4 * width * i; };
+    auto left = ssize_t{}, top = ssize_t{}, right = ssize_t{},
+         bottom = ssize_t{};
+    {
+      auto const& nogil = py::gil_scoped_release{};
+      std::tie(left, top, right, bottom) =
+        find_drawn_bounds(buf.data(), width, buf.shape(0), 4 * width);
+    }
+    if (top == bottom) {
+      return std::tuple{
+        py::array{py::array_t<uint8_t>{{0, 0, 4}}},
+        std::tuple{ssize_t{0}, ssize_t{0}, ssize_t{0}, ssize_t{0}}};
+    }
+    auto const& w = right - left, & h = bottom - top;
+    auto array = py::array_t<uint8_t, py::array::c_style>{{h, w, ssize_t{4}}};
+    convert_rows(
+      {array, array.mutable_data(), h, w, 4 * w},
+      [&](ssize_t i, uint8_t* dst) {
+        auto const& src = row(top + i) + 4 * left;
+        if constexpr (std::is_same_v<T, uint8_t>) {
+          pixel::argb32_to_straight_rgba8888(src, dst, w);
+        } else {
+          pixel::rgba128f_to_argb32(src, dst, w);
+          pixel::argb32_to_straight_rgba8888(dst, dst, w);
+        }
+      });
+    return std::tuple{py::array{array}, std::tuple{left, top, w, h}};
+  }, buf);
 }
 
 PYBIND11_MODULE(_mplcairo, m)
@@ -1970,6 +3217,8 @@ PYBIND11_MODULE(_mplcairo, m)
 
   FT_CHECK(FT_Init_FreeType, &detail::ft_library);
 
+  pixel::set_simd(pixel::available_simd().back());
+
   detail::RC_PARAMS = py::module::import("matplotlib").attr("rcParams");
   detail::PIXEL_MARKER =
     py::module::import("matplotlib.markers").attr("MarkerStyle")(",");
@@ -2012,12 +3261,27 @@ PYBIND11_MODULE(_mplcairo, m)
         }
         detail::FLOAT_SURFACE = *float_surface;
       }
+      if (auto const& size = pop_option("image_cache_size", ssize_t{})) {
+        detail::IMAGE_CACHE_SIZE = *size;
+        auto const& lock = std::lock_guard{detail::IMAGE_CACHE_MUTEX};
+        detail::IMAGE_CACHE.trim();
+      }
       if (auto const& threads = pop_option("collection_threads", int{})) {
         detail::COLLECTION_THREADS = *threads;
       }
+      if (auto const& threads = pop_option("conversion_threads", int{})) {
+        detail::CONVERSION_THREADS = *threads;
+      }
+      if (auto const& threshold =
+            pop_option("conversion_threshold", ssize_t{})) {
+        detail::CONVERSION_THRESHOLD = *threshold;
+      }
       if (auto const& miter_limit = pop_option("miter_limit", double{})) {
         detail::MITER_LIMIT = *miter_limit;
       }
+      if (auto const& threads = pop_option("png_threads", int{})) {
+        detail::PNG_THREADS = *threads;
+      }
       if (auto const& raqm = pop_option("raqm", bool{})) {
         if (*raqm) {
           load_raqm();
@@ -2025,9 +3289,18 @@ PYBIND11_MODULE(_mplcairo, m)
           unload_raqm();
         }
       }
+      if (auto const& size = pop_option("renderer_pool_size", ssize_t{})) {
+        detail::RENDERER_POOL_SIZE = *size;
+      }
+      if (auto const& tile_height = pop_option("tile_height", int{})) {
+        detail::TILE_HEIGHT = *tile_height;
+      }
       if (auto const& debug = pop_option("_debug", bool{})) {
         detail::DEBUG = *debug;
       }
+      if (auto const& simd = pop_option("_simd", std::string{})) {
+        pixel::set_simd(*simd);
+      }
       if (py::bool_(kwargs)) {
         throw std::runtime_error{
           "unknown options passed to set_options: {}"_format(kwargs)
@@ -2052,23 +3325,65 @@ cairo_circles : bool, default: True
 collection_threads : int, default: 0
     Number of threads to use to render markers and collections, if nonzero.
 
+conversion_threads : int, default: the number of CPUs
+    Number of threads to use for pixel format conversions (``cairo_to_*``
+    functions, and image premultiplication) and native rasterization (of quad
+    meshes and Gouraud-shaded triangles), for images of at least
+    *conversion_threshold* pixels.  The threads are taken from a pool that is
+    shared with other parallelized operations.
+
+conversion_threshold : int, default: 2**20
+    Pixel count above which pixel format conversions are parallelized.
+
 float_surface : bool, default: False
     Whether to use a floating point surface (more accurate, but uses more
     memory).
 
+image_cache_size : int, default: 2**26
+    Maximum total size, in bytes, of the premultiplied images kept (keyed by a
+    digest of their contents) for reuse when the same image data is drawn
+    again, e.g. in animations where an image does not change between frames.
+    The least recently used ones are evicted first.  Set to 0 to disable
+    caching (and hashing).
+
 miter_limit : float, default: 10
     Setting for cairo_set_miter_limit__.  If negative, use Matplotlib's (bad)
     default of matching the linewidth.  The default matches cairo's default.
 
     __ https://www.cairographics.org/manual/cairo-cairo-t.html#cairo-set-miter-limit
 
+png_threads : int, default: 1
+    Number of threads to use to compress PNG output.  If greater than 1, the
+    image is split into segments that are compressed independently (as done
+    by pigz), which is much faster for large images but yields slightly larger
+    files.  Can be overridden per call with ``pil_kwargs={"threads": ...}``.
+
 raqm : bool, default: if available
     Whether to use Raqm for text rendering.
 
+renderer_pool_size : int, default: 2**26
+    Maximum total size, in bytes, of the surfaces of idle raster renderers
+    that are kept for reuse by canvases (of any figure) of the same size, dpi
+    and surface format.  The least recently used ones are evicted first.
+
+tile_height : int, default: 0
+    If nonzero, PNG output taller than this many pixels is rendered in
+    horizontal bands of that height: the figure is first recorded, and then
+    replayed band by band into small image surfaces, which are converted in
+    parallel (using *conversion_threads*) and streamed to the PNG encoder.
+    Peak memory use then scales with the band size rather than with the full
+    image size, which allows writing gigapixel images.
+
 _debug: bool, default: False
     Whether to print debugging information.  This option is only intended for
     debugging and is not part of the stable API.
 
+_simd: str, default: the best one available
+    The SIMD instruction set used for pixel format conversions: one of "none",
+    "sse4.1", "avx2", or "avx512" (only those supported by the CPU can be
+    selected).  This option is only intended for debugging and is not part of
+    the stable API.
+
 Notes
 -----
 An additional format-specific control knob is the ``MaxVersion`` entry in the
@@ -2082,29 +3397,90 @@ to SVG 1.1 or 1.2 -- default: 1.1).
       return py::dict(
         "cairo_circles"_a=bool(detail::UNIT_CIRCLE),
         "collection_threads"_a=detail::COLLECTION_THREADS,
+        "conversion_threads"_a=detail::CONVERSION_THREADS,
+        "conversion_threshold"_a=detail::CONVERSION_THRESHOLD,
         "float_surface"_a=detail::FLOAT_SURFACE,
+        "image_cache_size"_a=detail::IMAGE_CACHE_SIZE,
         "miter_limit"_a=detail::MITER_LIMIT,
+        "png_threads"_a=detail::PNG_THREADS,
         "raqm"_a=has_raqm(),
-        "_debug"_a=detail::DEBUG);
+        "renderer_pool_size"_a=detail::RENDERER_POOL_SIZE,
+        "tile_height"_a=detail::TILE_HEIGHT,
+        "_debug"_a=detail::DEBUG,
+        "_simd"_a=pixel::get_simd());
     }, R"__doc__(
 Get current mplcairo options.  See `set_options` for a description of available
 options.
 )__doc__");
   m.def(
-    "cairo_to_premultiplied_argb32", cairo_to_premultiplied_argb32, R"__doc__(
+    "cairo_to_premultiplied_argb32", cairo_to_premultiplied_argb32,
+    "buf"_a, py::kw_only{}, "out"_a=py::none(), R"__doc__(
 Convert a buffer from cairo's ARGB32 (premultiplied) or RGBA128F to
 premultiplied ARGB32.
+
+If *out* is not given, a uint8 *buf* is returned as is.  See
+`cairo_to_straight_rgba8888` for the semantics of *out*.
 )__doc__");
   m.def(
-    "cairo_to_premultiplied_rgba8888", cairo_to_premultiplied_rgba8888, R"__doc__(
+    "cairo_to_premultiplied_rgba8888", cairo_to_premultiplied_rgba8888,
+    "buf"_a, py::kw_only{}, "out"_a=py::none(), R"__doc__(
 Convert a buffer from cairo's ARGB32 (premultiplied) or RGBA128F to
 premultiplied RGBA8888.
+
+See `cairo_to_straight_rgba8888` for the semantics of *out*.
 )__doc__");
   m.def(
-    "cairo_to_straight_rgba8888", cairo_to_straight_rgba8888, R"__doc__(
+    "cairo_to_straight_rgba8888", cairo_to_straight_rgba8888,
+    "buf"_a, py::kw_only{}, "out"_a=py::none(), R"__doc__(
 Convert a buffer from cairo's ARGB32 (premultiplied) or RGBA128F to
 straight RGBA8888.
+
+If *out* is given, the result is written into it, and it is returned.  *out*
+must be a writeable uint8 array with the same shape as *buf*; if it has shape
+(m, n, 4), its rows may be strided (e.g., a view into a larger, possibly
+shared-memory, array), as long as each row is contiguous and rows do not
+overlap (i.e., with a row stride of at least 4 * n bytes).  A uint8 *buf* can
+be converted in place by passing it as *out* too.  Otherwise, a new array is
+allocated.
+)__doc__");
+  m.def(
+    "_get_drawn_subarray_and_bounds", get_drawn_subarray_and_bounds, R"__doc__(
+Return the drawn (i.e., not fully transparent) region of a buffer in cairo's
+ARGB32 (premultiplied) or RGBA128F format, converted to straight RGBA8888, and
+its ``(l, b, w, h)`` bounds (where *b* is the index of the region's first row).
 )__doc__");
+#ifdef MPLCAIRO_USE_ZLIB
+  m.def(
+    "write_png", write_png,
+    "buf"_a, "file"_a, py::kw_only{}, "compress_level"_a=-1,
+    "filter"_a="adaptive", "metadata"_a=py::dict{}, "dpi"_a=py::none(),
+    "threads"_a=py::none(), R"__doc__(
+Write a buffer in cairo's ARGB32 (premultiplied) or RGBA128F format as a
+straight RGBA PNG.
+
+Rows are converted and compressed incrementally, so that no full-size
+intermediate copy of the image is made.
+
+Parameters
+----------
+buf : array of shape (height, width, 4)
+file : binary file-like object
+    Output stream; only its ``write`` method is used.
+compress_level : int, default: -1
+    zlib compression level, from 0 (no compression) to 9; -1 selects zlib's
+    default (6).
+filter : {"adaptive", "none", "sub", "up", "average", "paeth"}
+    PNG row filter.  "adaptive" picks the best filter for each row, at some
+    speed cost; "none" together with a low *compress_level* (e.g. 1) is the
+    fastest combination, e.g. for previews.
+metadata : dict
+    Text chunks; None values are skipped.
+dpi : Optional[Tuple[float, float]]
+    Resolution stored in the pHYs chunk.
+threads : Optional[int]
+    Number of compression threads; defaults to the *png_threads* option.
+)__doc__");
+#endif
   m.def(
     "get_versions", [] {
       auto const& cairo_version = cairo_version_string();
@@ -2155,6 +3531,8 @@ Only intended for debugging purposes.
     // The RendererAgg signature, which is also expected by MixedModeRenderer
     // (with doubles!).
     .def(py::init<double, double, double>())
+    .def(py::init<double, double, double, bool>())
+    .def(py::init<py::buffer, double>())
     .def(py::init<
          py::object, double, double, double, std::tuple<double, double>>())
     .def(py::init<
@@ -2190,6 +3568,16 @@ Only intended for debugging purposes.
     .def("_show_page", &GraphicsContextRenderer::_show_page)
     .def("_get_context", &GraphicsContextRenderer::_get_context)
     .def("_get_buffer", &GraphicsContextRenderer::_get_buffer)
+    .def(
+      "_replay", &GraphicsContextRenderer::_replay,
+      "recording"_a, "scale"_a=1.)
+#ifdef MPLCAIRO_USE_ZLIB
+    .def(
+      "_write_tiled_png", &GraphicsContextRenderer::_write_tiled_png,
+      "file"_a, py::kw_only{}, "compress_level"_a=-1,
+      "filter"_a="adaptive", "metadata"_a=py::dict{}, "dpi"_a=py::none(),
+      "threads"_a=py::none())
+#endif
     .def("_finish", &GraphicsContextRenderer::_finish)
 
     // GraphicsContext API.
@@ -2323,9 +3711,12 @@ Only intended for debugging purposes.
          &GraphicsContextRenderer::get_text_width_height_descent,
          "s"_a, "prop"_a, "ismath"_a)
 
-    .def("start_filter", &GraphicsContextRenderer::start_filter)
+    .def("start_filter", &GraphicsContextRenderer::start_filter,
+         "bbox"_a=py::none())
     .def("_stop_filter_get_buffer",
          &GraphicsContextRenderer::_stop_filter_get_buffer)
+    .def("start_rasterizing", &GraphicsContextRenderer::start_rasterizing)
+    .def("stop_rasterizing", &GraphicsContextRenderer::stop_rasterizing)
 
     // FIXME[matplotlib]: Needed for webagg_core, although we also use it.
     .def(
@@ -2349,7 +3740,15 @@ Backend rendering mathtext to a cairo recording surface.
     .def(py::init<>())
     .def("add_glyph", &MathtextBackend::add_glyph)
     .def("add_usetex_glyph", &MathtextBackend::add_usetex_glyph)
+    .def("add_usetex_glyphs", &MathtextBackend::add_usetex_glyphs,
+         "ox"_a, "oy"_a, "filenames"_a, "sizes"_a, "names_or_indices"_a,
+         "slants"_a, "extends"_a, R"__doc__(
+Add many usetex glyphs at once; all arguments are sequences of equal length.
+)__doc__")
     .def("add_rect", &MathtextBackend::add_rect)
+    .def("add_rects", &MathtextBackend::add_rects, R"__doc__(
+Add many rectangles at once, from an array of ``(x1, y1, x2, y2)`` rows.
+)__doc__")
     .def("draw", &MathtextBackend::draw)
     ;
 }
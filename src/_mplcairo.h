@@ -7,7 +7,7 @@ namespace mplcairo {
 namespace py = pybind11;
 
 enum class StreamSurfaceType {
-  PDF, PS, EPS, SVG, Script
+  PDF, PS, EPS, SVG, Script, Recording
 };
 
 struct Region {
@@ -44,6 +44,7 @@ class GraphicsContextRenderer {
 
   double pixels_to_points(double pixels);
   rgba_t get_rgba();
+  std::tuple<cairo_surface_t*, int, int> pop_group_to_image(double scale);
 
   public:
 
@@ -53,6 +54,11 @@ class GraphicsContextRenderer {
 
   static cairo_t* cr_from_image_args(int width, int height);
   GraphicsContextRenderer(double width, double height, double dpi);
+  static cairo_t* cr_from_tiled_args(int width, int height);
+  GraphicsContextRenderer(
+    double width, double height, double dpi, bool tiled);
+  static cairo_t* cr_from_buffer_args(py::buffer buf);
+  GraphicsContextRenderer(py::buffer buf, double dpi);
   static cairo_t* cr_from_pycairo_ctx(
     py::object ctx, std::tuple<double, double> device_scales);
   GraphicsContextRenderer(
@@ -76,6 +82,13 @@ class GraphicsContextRenderer {
   void _show_page();
   py::object _get_context();
   py::array _get_buffer();
+  void _replay(GraphicsContextRenderer& recording, double scale);
+#ifdef MPLCAIRO_USE_ZLIB
+  void _write_tiled_png(
+    py::object file, int compress_level, std::string filter,
+    py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+    std::optional<int> threads);
+#endif
   void _finish();
 
   void set_alpha(std::optional<double> alpha);
@@ -107,12 +120,13 @@ class GraphicsContextRenderer {
 
   void draw_gouraud_triangles(
     GraphicsContextRenderer& gc,
-    py::array_t<double> triangles,
+    py::array_t<double, py::array::c_style | py::array::forcecast> triangles,
     py::array_t<double> colors,
     py::object transform);
   void draw_image(
     GraphicsContextRenderer& gc,
-    double x, double y, py::array_t<uint8_t> im);
+    double x, double y,
+    py::array_t<uint8_t, py::array::c_style | py::array::forcecast> im);
   void draw_path(
     GraphicsContextRenderer& gc,
     py::object path,
@@ -144,7 +158,9 @@ class GraphicsContextRenderer {
     GraphicsContextRenderer& gc,
     py::object master_transform,
     ssize_t mesh_width, ssize_t mesh_height,
-    py::array_t<double> coordinates,
+    std::variant<
+      py::array_t<double, py::array::c_style | py::array::forcecast>,
+      py::array_t<float, py::array::c_style>> coordinates,
     py::array_t<double> offsets,
     py::object offset_transform,
     py::array_t<double> fcs,
@@ -157,8 +173,10 @@ class GraphicsContextRenderer {
   std::tuple<double, double, double> get_text_width_height_descent(
     std::string s, py::object prop, py::object ismath);
 
-  void start_filter();
-  py::array _stop_filter_get_buffer();
+  void start_filter(std::optional<py::object> bbox = {});
+  std::tuple<py::array, std::tuple<int, int>> _stop_filter_get_buffer();
+  void start_rasterizing();
+  void stop_rasterizing();
 
   Region copy_from_bbox(py::object bbox);
   void restore_region(Region& region);
@@ -197,18 +215,31 @@ class MathtextBackend {
     double ox, double oy, std::string filename, double size,
     std::variant<std::string, FT_ULong> name_or_index,
     double slant, double extend);
+  void add_usetex_glyphs(
+    py::array_t<double> ox, py::array_t<double> oy,
+    std::vector<std::string> filenames, py::array_t<double> sizes,
+    std::vector<std::variant<std::string, FT_ULong>> names_or_indices,
+    py::array_t<double> slants, py::array_t<double> extends);
   void add_rect(double x1, double y1, double x2, double y2);
+  void add_rects(py::array_t<double> rects);
   void draw(
     GraphicsContextRenderer& gcr, double x, double y, double angle) const;
 };
 
-py::array_t<uint8_t, py::array::c_style> cairo_to_premultiplied_argb32(
+py::array cairo_to_premultiplied_argb32(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
-               py::array_t<float, py::array::c_style>> buf);
-py::array_t<uint8_t, py::array::c_style> cairo_to_premultiplied_rgba8888(
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out = {});
+py::array cairo_to_premultiplied_rgba8888(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
-               py::array_t<float, py::array::c_style>> buf);
-py::array_t<uint8_t, py::array::c_style> cairo_to_straight_rgba8888(
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out = {});
+py::array cairo_to_straight_rgba8888(
+  std::variant<py::array_t<uint8_t, py::array::c_style>,
+               py::array_t<float, py::array::c_style>> buf,
+  std::optional<py::array> out = {});
+std::tuple<py::array, std::tuple<ssize_t, ssize_t, ssize_t, ssize_t>>
+get_drawn_subarray_and_bounds(
   std::variant<py::array_t<uint8_t, py::array::c_style>,
                py::array_t<float, py::array::c_style>> buf);
 
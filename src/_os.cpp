@@ -3,7 +3,11 @@
 #if defined __linux__ || defined __APPLE__
   #include <dlfcn.h>
   #include <execinfo.h>
+  #include <fcntl.h>
   #include <signal.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
 #elif defined _WIN32
   #include <memory>
   #define NOMINMAX
@@ -53,6 +57,32 @@ void install_abrt_handler()
   });
 }
 
+std::shared_ptr<MappedFile> MappedFile::open(std::string const& path)
+{
+  auto const& fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return nullptr;
+  }
+  struct stat st{};
+  auto data = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size > 0) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);  // The mapping stays valid.
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  auto mapped_file = std::shared_ptr<MappedFile>{new MappedFile};
+  mapped_file->data_ = data;
+  mapped_file->size_ = st.st_size;
+  return mapped_file;
+}
+
+MappedFile::~MappedFile()
+{
+  munmap(data_, size_);
+}
+
 #elif defined _WIN32
 using library_t = HMODULE;
 using symbol_t = FARPROC;
@@ -100,6 +130,59 @@ void install_abrt_handler()
 {
 }
 
+std::shared_ptr<MappedFile> MappedFile::open(std::string const& path)
+{
+  auto const& n_wchars =
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+  if (!n_wchars) {
+    return nullptr;
+  }
+  auto wpath = std::wstring(n_wchars, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), n_wchars);
+  auto const& file = CreateFileW(
+    wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  auto size = LARGE_INTEGER{};
+  auto mapping = HANDLE{};
+  auto data = static_cast<void*>(nullptr);
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0
+      && (mapping =
+            CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+      && !(data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))) {
+    CloseHandle(mapping);
+  }
+  if (!data) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  auto mapped_file = std::shared_ptr<MappedFile>{new MappedFile};
+  mapped_file->file_ = file;
+  mapped_file->mapping_ = mapping;
+  mapped_file->data_ = data;
+  mapped_file->size_ = size.QuadPart;
+  return mapped_file;
+}
+
+MappedFile::~MappedFile()
+{
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
 #endif
 
+unsigned char const* MappedFile::data() const
+{
+  return static_cast<unsigned char const*>(data_);
+}
+
+size_t MappedFile::size() const
+{
+  return size_;
+}
+
 }
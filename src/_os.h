@@ -1,4 +1,6 @@
 #include <iostream>
+#include <memory>
+#include <string>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -24,4 +26,28 @@ void throw_dlerror();
 
 void install_abrt_handler();
 
+// A read-only, shared mapping of a whole file.  Processes mapping the same
+// file (e.g., forked workers) share the underlying pages.
+class MappedFile {
+#if defined __linux__ || defined __APPLE__
+  void* data_;
+#elif defined _WIN32
+  HANDLE file_, mapping_;
+  void* data_;
+#endif
+  size_t size_;
+
+  MappedFile() = default;
+
+  public:
+  MappedFile(MappedFile const&) = delete;
+  MappedFile& operator=(MappedFile const&) = delete;
+  ~MappedFile();
+
+  // Returns nullptr on failure.
+  static std::shared_ptr<MappedFile> open(std::string const& path);
+  unsigned char const* data() const;
+  size_t size() const;
+};
+
 }
@@ -0,0 +1,845 @@
+#include "_pixel.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+  #define MPLCAIRO_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+  #if defined __GNUC__ || defined __clang__
+    #define TARGET(isa) __attribute__((target(isa)))
+  #else  // MSVC allows intrinsics for any instruction set anywhere.
+    #define TARGET(isa)
+  #endif
+#endif
+
+#include "_util.h"
+
+namespace mplcairo::pixel {
+
+namespace {
+
+bool is_little_endian()
+{
+  return *reinterpret_cast<uint16_t const*>("\0\xff") > 0x100;
+}
+
+// Scalar kernels.
+
+void argb32_to_premultiplied_rgba8888_scalar(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  if (is_little_endian()) {
+    for (auto i = size_t{}; i < 4 * n; i += 4) {
+      auto const b = src[i], g = src[i + 1], r = src[i + 2], a = src[i + 3];
+      dst[i] = r; dst[i + 1] = g; dst[i + 2] = b; dst[i + 3] = a;  // BGRA->RGBA
+    }
+  } else {
+    auto const& src32 = reinterpret_cast<uint32_t const*>(src);
+    auto const& dst32 = reinterpret_cast<uint32_t*>(dst);
+    for (auto i = size_t{}; i < n; ++i) {
+      dst32[i] = (src32[i] << 8) + (src32[i] >> 24);  // ARGB->RGBA
+    }
+  }
+}
+
+void argb32_to_straight_rgba8888_scalar(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  argb32_to_premultiplied_rgba8888_scalar(src, dst, n);
+  for (auto i = size_t{}; i < 4 * n; i += 4) {
+    auto const& a = dst[i + 3];
+    if (a != 0xff) {
+      // Relying on a precomputed table yields a ~2x speedup, but avoiding the
+      // table lookup in the opaque case is still faster.
+      auto const& subtable = &detail::unpremultiplication_table[a << 8];
+      dst[i] = subtable[dst[i]];
+      dst[i + 1] = subtable[dst[i + 1]];
+      dst[i + 2] = subtable[dst[i + 2]];
+    }
+  }
+}
+
+void rgba128f_to_argb32_scalar(float const* src, uint8_t* dst, size_t n)
+{
+  auto const& dst32 = reinterpret_cast<uint32_t*>(dst);
+  for (auto i = size_t{}; i < n; ++i) {
+    auto const& r = src[4 * i], g = src[4 * i + 1],
+                b = src[4 * i + 2], a = src[4 * i + 3];
+    dst32[i] =
+      (uint32_t(uint8_t(a * 0xff)) << 24)
+      + (uint32_t(uint8_t(r * 0xff)) << 16)
+      + (uint32_t(uint8_t(g * 0xff)) << 8)
+      + (uint32_t(uint8_t(b * 0xff)) << 0);
+  }
+}
+
+void straight_rgba8888_to_argb32_scalar(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& dst32 = reinterpret_cast<uint32_t*>(dst);
+  for (auto i = size_t{}; i < n; ++i) {
+    auto r = src[4 * i], g = src[4 * i + 1], b = src[4 * i + 2];
+    auto const a = src[4 * i + 3];
+    if (a != 0xff) {
+      auto const& subtable = &detail::premultiplication_table[a << 8];
+      r = subtable[r];
+      g = subtable[g];
+      b = subtable[b];
+    }
+    dst32[i] = (uint32_t(a) << 24) + (r << 16) + (g << 8) + (b << 0);
+  }
+}
+
+size_t argb32_first_drawn_scalar(uint8_t const* src, size_t n)
+{
+  auto const& src32 = reinterpret_cast<uint32_t const*>(src);
+  auto i = size_t{};
+  for (; i < n && !(src32[i] & 0xff000000); ++i) {}
+  return i;
+}
+
+size_t argb32_end_drawn_scalar(uint8_t const* src, size_t n)
+{
+  auto const& src32 = reinterpret_cast<uint32_t const*>(src);
+  auto i = n;
+  for (; i && !(src32[i - 1] & 0xff000000); --i) {}
+  return i;
+}
+
+void rgba128f_over_gradient_scalar(
+  float* dst, float const* color, float const* step, size_t n)
+{
+  for (auto i = size_t{}; i < n; ++i) {
+    float c[4];
+    for (auto k = 0; k < 4; ++k) {
+      c[k] = color[k] + float(i) * step[k];
+    }
+    for (auto k = 0; k < 4; ++k) {
+      dst[4 * i + k] = c[k] + dst[4 * i + k] * (1 - c[3]);
+    }
+  }
+}
+
+#ifdef MPLCAIRO_X86
+
+// SIMD kernels.  They are bit-for-bit identical to the scalar ones (for inputs
+// in the valid range); in particular, the unpremultiplication
+// (c * 255 + a / 2) / a (for c <= a, and 0 otherwise) is computed in single
+// precision, which is exact after truncation because the numerator is below
+// 2**16 and the distance of the quotient to the next integer is at least 1/a.
+// The tails that don't fill a whole vector are handed to the scalar kernels.
+
+// BGRA<->RGBA, within each 16-byte lane.
+#define SWAP_RB_MASK \
+  2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+// Unpremultiply pixels, expanded to one int32 per channel.
+TARGET("sse4.1") __m128i unpremultiply_epi32_sse41(__m128i c)
+{
+  auto const& a = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 3, 3, 3));
+  auto const& num =
+    _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(c, 8), c), _mm_srli_epi32(a, 1));
+  auto const& den = _mm_max_epi32(a, _mm_set1_epi32(1));
+  auto const& q = _mm_andnot_si128(
+    _mm_cmpgt_epi32(c, a),
+    _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), _mm_cvtepi32_ps(den))));
+  return _mm_blend_epi16(q, c, 0xc0);  // Keep alpha.
+}
+
+TARGET("avx2") __m256i unpremultiply_epi32_avx2(__m256i c)
+{
+  auto const& a = _mm256_shuffle_epi32(c, _MM_SHUFFLE(3, 3, 3, 3));
+  auto const& num = _mm256_add_epi32(
+    _mm256_sub_epi32(_mm256_slli_epi32(c, 8), c), _mm256_srli_epi32(a, 1));
+  auto const& den = _mm256_max_epi32(a, _mm256_set1_epi32(1));
+  auto const& q = _mm256_andnot_si256(
+    _mm256_cmpgt_epi32(c, a),
+    _mm256_cvttps_epi32(
+      _mm256_div_ps(_mm256_cvtepi32_ps(num), _mm256_cvtepi32_ps(den))));
+  return _mm256_blend_epi32(q, c, 0x88);  // Keep alpha.
+}
+
+TARGET("avx512f,avx512bw") __m512i unpremultiply_epi32_avx512(__m512i c)
+{
+  auto const& a = _mm512_shuffle_epi32(c, _MM_PERM_DDDD);
+  auto const& num = _mm512_add_epi32(
+    _mm512_sub_epi32(_mm512_slli_epi32(c, 8), c), _mm512_srli_epi32(a, 1));
+  auto const& den = _mm512_max_epi32(a, _mm512_set1_epi32(1));
+  auto const& q = _mm512_maskz_cvttps_epi32(
+    _mm512_cmple_epi32_mask(c, a),
+    _mm512_div_ps(_mm512_cvtepi32_ps(num), _mm512_cvtepi32_ps(den)));
+  return _mm512_mask_blend_epi32(0x8888, q, c);  // Keep alpha.
+}
+
+TARGET("avx512f,avx512bw") __m128i unpremultiply_epi8_avx512(__m128i v)
+{
+  return _mm512_cvtepi32_epi8(
+    unpremultiply_epi32_avx512(_mm512_cvtepu8_epi32(v)));
+}
+
+// Scale floats by 255 and truncate them, clamping to [0, 255].  (The lower
+// clamp is provided by the unsigned saturation in the packs, for SSE and AVX2.)
+TARGET("sse4.1") __m128i convert_epi32_sse41(float const* ptr)
+{
+  return _mm_min_epi32(
+    _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(ptr), _mm_set1_ps(0xff))),
+    _mm_set1_epi32(0xff));
+}
+
+TARGET("avx2") __m256i convert_epi32_avx2(float const* ptr)
+{
+  return _mm256_min_epi32(
+    _mm256_cvttps_epi32(
+      _mm256_mul_ps(_mm256_loadu_ps(ptr), _mm256_set1_ps(0xff))),
+    _mm256_set1_epi32(0xff));
+}
+
+TARGET("avx512f,avx512bw") __m128i convert_epi8_avx512(float const* ptr)
+{
+  return _mm512_cvtepi32_epi8(
+    _mm512_max_epi32(
+      _mm512_min_epi32(
+        _mm512_cvttps_epi32(
+          _mm512_mul_ps(_mm512_loadu_ps(ptr), _mm512_set1_ps(0xff))),
+        _mm512_set1_epi32(0xff)),
+      _mm512_setzero_si512()));
+}
+
+TARGET("sse4.1") void argb32_to_premultiplied_rgba8888_sse41(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm_setr_epi8(SWAP_RB_MASK);
+  auto i = size_t{};
+  for (; i + 4 <= n; i += 4) {
+    auto const& v =
+      _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + 4 * i));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i*>(dst + 4 * i), _mm_shuffle_epi8(v, swap_rb));
+  }
+  argb32_to_premultiplied_rgba8888_scalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("sse4.1") void argb32_to_straight_rgba8888_sse41(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm_setr_epi8(SWAP_RB_MASK);
+  auto const& alpha = _mm_set1_epi32(int(0xff000000)),
+              not_alpha = _mm_set1_epi32(0x00ffffff);
+  auto i = size_t{};
+  for (; i + 4 <= n; i += 4) {
+    auto v = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + 4 * i)), swap_rb);
+    if (_mm_test_all_zeros(v, alpha)) {  // All transparent.
+      v = _mm_setzero_si128();
+    } else if (!_mm_test_all_ones(_mm_or_si128(v, not_alpha))) {  // Not opaque.
+      auto const& p0 = unpremultiply_epi32_sse41(_mm_cvtepu8_epi32(v)),
+                  p1 = unpremultiply_epi32_sse41(
+                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 4))),
+                  p2 = unpremultiply_epi32_sse41(
+                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 8))),
+                  p3 = unpremultiply_epi32_sse41(
+                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+      v = _mm_packus_epi16(_mm_packus_epi32(p0, p1), _mm_packus_epi32(p2, p3));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), v);
+  }
+  argb32_to_straight_rgba8888_scalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("sse4.1") void rgba128f_to_argb32_sse41(
+  float const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm_setr_epi8(SWAP_RB_MASK);
+  auto i = size_t{};
+  for (auto ptr = src; i + 4 <= n; i += 4, ptr += 16) {
+    auto const& v = _mm_packus_epi16(
+      _mm_packus_epi32(
+        convert_epi32_sse41(ptr), convert_epi32_sse41(ptr + 4)),
+      _mm_packus_epi32(
+        convert_epi32_sse41(ptr + 8), convert_epi32_sse41(ptr + 12)));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i*>(dst + 4 * i), _mm_shuffle_epi8(v, swap_rb));
+  }
+  rgba128f_to_argb32_scalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+// AVX2 packs work within 128-bit lanes; this permutation restores the order
+// of the pixels after two rounds of packing.
+TARGET("avx2") __m256i pack_epi32_avx2(
+  __m256i p0, __m256i p1, __m256i p2, __m256i p3)
+{
+  return _mm256_permutevar8x32_epi32(
+    _mm256_packus_epi16(_mm256_packus_epi32(p0, p1),
+                        _mm256_packus_epi32(p2, p3)),
+    _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+TARGET("avx2") void argb32_to_premultiplied_rgba8888_avx2(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm256_setr_epi8(SWAP_RB_MASK, SWAP_RB_MASK);
+  auto i = size_t{};
+  for (; i + 8 <= n; i += 8) {
+    auto const& v =
+      _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + 4 * i));
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i*>(dst + 4 * i), _mm256_shuffle_epi8(v, swap_rb));
+  }
+  argb32_to_premultiplied_rgba8888_sse41(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx2") void argb32_to_straight_rgba8888_avx2(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm256_setr_epi8(SWAP_RB_MASK, SWAP_RB_MASK);
+  auto const& alpha = _mm256_set1_epi32(int(0xff000000)),
+              not_alpha = _mm256_set1_epi32(0x00ffffff),
+              ones = _mm256_set1_epi32(-1);
+  auto i = size_t{};
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_shuffle_epi8(
+      _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + 4 * i)),
+      swap_rb);
+    if (_mm256_testz_si256(v, alpha)) {  // All transparent.
+      v = _mm256_setzero_si256();
+    } else if (!_mm256_testc_si256(_mm256_or_si256(v, not_alpha), ones)) {
+      auto const& lo = _mm256_castsi256_si128(v),
+                  hi = _mm256_extracti128_si256(v, 1);
+      v = pack_epi32_avx2(
+        unpremultiply_epi32_avx2(_mm256_cvtepu8_epi32(lo)),
+        unpremultiply_epi32_avx2(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))),
+        unpremultiply_epi32_avx2(_mm256_cvtepu8_epi32(hi)),
+        unpremultiply_epi32_avx2(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i), v);
+  }
+  argb32_to_straight_rgba8888_sse41(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx2") void rgba128f_to_argb32_avx2(
+  float const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm256_setr_epi8(SWAP_RB_MASK, SWAP_RB_MASK);
+  auto i = size_t{};
+  for (auto ptr = src; i + 8 <= n; i += 8, ptr += 32) {
+    auto const& v = pack_epi32_avx2(
+      convert_epi32_avx2(ptr), convert_epi32_avx2(ptr + 8),
+      convert_epi32_avx2(ptr + 16), convert_epi32_avx2(ptr + 24));
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i*>(dst + 4 * i), _mm256_shuffle_epi8(v, swap_rb));
+  }
+  rgba128f_to_argb32_sse41(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx512f,avx512bw") void argb32_to_premultiplied_rgba8888_avx512(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm512_broadcast_i32x4(_mm_setr_epi8(SWAP_RB_MASK));
+  auto i = size_t{};
+  for (; i + 16 <= n; i += 16) {
+    auto const& v = _mm512_loadu_si512(src + 4 * i);
+    _mm512_storeu_si512(dst + 4 * i, _mm512_shuffle_epi8(v, swap_rb));
+  }
+  argb32_to_premultiplied_rgba8888_avx2(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx512f,avx512bw") void argb32_to_straight_rgba8888_avx512(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm512_broadcast_i32x4(_mm_setr_epi8(SWAP_RB_MASK));
+  auto const& alpha = _mm512_set1_epi32(int(0xff000000));
+  auto i = size_t{};
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm512_shuffle_epi8(_mm512_loadu_si512(src + 4 * i), swap_rb);
+    if (!_mm512_test_epi32_mask(v, alpha)) {  // All transparent.
+      v = _mm512_setzero_si512();
+    } else if (  // Not opaque.
+        _mm512_cmpneq_epi32_mask(_mm512_and_si512(v, alpha), alpha)) {
+      v = _mm512_inserti32x4(
+        _mm512_inserti32x4(
+          _mm512_inserti32x4(
+            _mm512_castsi128_si512(
+              unpremultiply_epi8_avx512(_mm512_castsi512_si128(v))),
+            unpremultiply_epi8_avx512(_mm512_extracti32x4_epi32(v, 1)), 1),
+          unpremultiply_epi8_avx512(_mm512_extracti32x4_epi32(v, 2)), 2),
+        unpremultiply_epi8_avx512(_mm512_extracti32x4_epi32(v, 3)), 3);
+    }
+    _mm512_storeu_si512(dst + 4 * i, v);
+  }
+  argb32_to_straight_rgba8888_avx2(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx512f,avx512bw") void rgba128f_to_argb32_avx512(
+  float const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm512_broadcast_i32x4(_mm_setr_epi8(SWAP_RB_MASK));
+  auto i = size_t{};
+  for (auto ptr = src; i + 16 <= n; i += 16, ptr += 64) {
+    auto const& v = _mm512_inserti32x4(
+      _mm512_inserti32x4(
+        _mm512_inserti32x4(
+          _mm512_castsi128_si512(convert_epi8_avx512(ptr)),
+          convert_epi8_avx512(ptr + 16), 1),
+        convert_epi8_avx512(ptr + 32), 2),
+      convert_epi8_avx512(ptr + 48), 3);
+    _mm512_storeu_si512(dst + 4 * i, _mm512_shuffle_epi8(v, swap_rb));
+  }
+  rgba128f_to_argb32_avx2(src + 4 * i, dst + 4 * i, n - i);
+}
+
+// Premultiply RGBA pixels, expanded to one int16 per channel.  c * a / 255
+// (truncated) is computed exactly as (x + 1 + (x >> 8)) >> 8, for x = c * a;
+// alpha is multiplied by 255 instead, and thus left unchanged.
+
+// Broadcast the alpha of each pixel to its int16 channels.
+#define ALPHA_EPI16_MASK \
+  6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15
+
+TARGET("sse4.1") __m128i premultiply_epi16_sse41(__m128i c)
+{
+  auto const& a = _mm_blend_epi16(
+    _mm_shuffle_epi8(c, _mm_setr_epi8(ALPHA_EPI16_MASK)),
+    _mm_set1_epi16(0xff), 0x88);
+  auto const& x = _mm_mullo_epi16(c, a);
+  return _mm_srli_epi16(
+    _mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)),
+    8);
+}
+
+TARGET("avx2") __m256i premultiply_epi16_avx2(__m256i c)
+{
+  auto const& a = _mm256_blend_epi16(
+    _mm256_shuffle_epi8(
+      c, _mm256_setr_epi8(ALPHA_EPI16_MASK, ALPHA_EPI16_MASK)),
+    _mm256_set1_epi16(0xff), 0x88);
+  auto const& x = _mm256_mullo_epi16(c, a);
+  return _mm256_srli_epi16(
+    _mm256_add_epi16(
+      _mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)),
+    8);
+}
+
+TARGET("avx512f,avx512bw") __m512i premultiply_epi16_avx512(__m512i c)
+{
+  auto const& a = _mm512_mask_blend_epi16(
+    0x88888888,
+    _mm512_shuffle_epi8(
+      c, _mm512_broadcast_i32x4(_mm_setr_epi8(ALPHA_EPI16_MASK))),
+    _mm512_set1_epi16(0xff));
+  auto const& x = _mm512_mullo_epi16(c, a);
+  return _mm512_srli_epi16(
+    _mm512_add_epi16(
+      _mm512_add_epi16(x, _mm512_set1_epi16(1)), _mm512_srli_epi16(x, 8)),
+    8);
+}
+
+#undef ALPHA_EPI16_MASK
+
+// Unpacking and repacking with the same (in-lane) order restores the order of
+// the pixels, and opaque vectors only need swizzling.
+
+TARGET("sse4.1") void straight_rgba8888_to_argb32_sse41(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm_setr_epi8(SWAP_RB_MASK);
+  auto const& alpha = _mm_set1_epi32(int(0xff000000)),
+              not_alpha = _mm_set1_epi32(0x00ffffff),
+              zero = _mm_setzero_si128();
+  auto i = size_t{};
+  for (; i + 4 <= n; i += 4) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + 4 * i));
+    if (_mm_test_all_zeros(v, alpha)) {  // All transparent.
+      v = zero;
+    } else if (!_mm_test_all_ones(_mm_or_si128(v, not_alpha))) {  // Not opaque.
+      v = _mm_packus_epi16(
+        premultiply_epi16_sse41(_mm_unpacklo_epi8(v, zero)),
+        premultiply_epi16_sse41(_mm_unpackhi_epi8(v, zero)));
+    }
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i*>(dst + 4 * i), _mm_shuffle_epi8(v, swap_rb));
+  }
+  straight_rgba8888_to_argb32_scalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx2") void straight_rgba8888_to_argb32_avx2(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm256_setr_epi8(SWAP_RB_MASK, SWAP_RB_MASK);
+  auto const& alpha = _mm256_set1_epi32(int(0xff000000)),
+              not_alpha = _mm256_set1_epi32(0x00ffffff),
+              ones = _mm256_set1_epi32(-1),
+              zero = _mm256_setzero_si256();
+  auto i = size_t{};
+  for (; i + 8 <= n; i += 8) {
+    auto v =
+      _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + 4 * i));
+    if (_mm256_testz_si256(v, alpha)) {  // All transparent.
+      v = zero;
+    } else if (!_mm256_testc_si256(_mm256_or_si256(v, not_alpha), ones)) {
+      v = _mm256_packus_epi16(
+        premultiply_epi16_avx2(_mm256_unpacklo_epi8(v, zero)),
+        premultiply_epi16_avx2(_mm256_unpackhi_epi8(v, zero)));
+    }
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i*>(dst + 4 * i), _mm256_shuffle_epi8(v, swap_rb));
+  }
+  straight_rgba8888_to_argb32_sse41(src + 4 * i, dst + 4 * i, n - i);
+}
+
+TARGET("avx512f,avx512bw") void straight_rgba8888_to_argb32_avx512(
+  uint8_t const* src, uint8_t* dst, size_t n)
+{
+  auto const& swap_rb = _mm512_broadcast_i32x4(_mm_setr_epi8(SWAP_RB_MASK));
+  auto const& alpha = _mm512_set1_epi32(int(0xff000000)),
+              zero = _mm512_setzero_si512();
+  auto i = size_t{};
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm512_loadu_si512(src + 4 * i);
+    if (!_mm512_test_epi32_mask(v, alpha)) {  // All transparent.
+      v = zero;
+    } else if (  // Not opaque.
+        _mm512_cmpneq_epi32_mask(_mm512_and_si512(v, alpha), alpha)) {
+      v = _mm512_packus_epi16(
+        premultiply_epi16_avx512(_mm512_unpacklo_epi8(v, zero)),
+        premultiply_epi16_avx512(_mm512_unpackhi_epi8(v, zero)));
+    }
+    _mm512_storeu_si512(dst + 4 * i, _mm512_shuffle_epi8(v, swap_rb));
+  }
+  straight_rgba8888_to_argb32_avx2(src + 4 * i, dst + 4 * i, n - i);
+}
+
+// The scanning kernels skip whole vectors of transparent pixels, and leave
+// locating the drawn pixel within a vector to the scalar kernels.
+
+TARGET("sse4.1") size_t argb32_first_drawn_sse41(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm_set1_epi32(int(0xff000000));
+  auto i = size_t{};
+  for (; i + 4 <= n; i += 4) {
+    if (!_mm_test_all_zeros(
+          _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + 4 * i)),
+          alpha)) {
+      break;
+    }
+  }
+  return i + argb32_first_drawn_scalar(src + 4 * i, n - i);
+}
+
+TARGET("sse4.1") size_t argb32_end_drawn_sse41(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm_set1_epi32(int(0xff000000));
+  auto i = n;
+  for (; i >= 4; i -= 4) {
+    if (!_mm_test_all_zeros(
+          _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(src + 4 * i - 16)),
+          alpha)) {
+      break;
+    }
+  }
+  return argb32_end_drawn_scalar(src, i);
+}
+
+TARGET("avx2") size_t argb32_first_drawn_avx2(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm256_set1_epi32(int(0xff000000));
+  auto i = size_t{};
+  for (; i + 8 <= n; i += 8) {
+    if (!_mm256_testz_si256(
+          _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + 4 * i)),
+          alpha)) {
+      break;
+    }
+  }
+  return i + argb32_first_drawn_sse41(src + 4 * i, n - i);
+}
+
+TARGET("avx2") size_t argb32_end_drawn_avx2(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm256_set1_epi32(int(0xff000000));
+  auto i = n;
+  for (; i >= 8; i -= 8) {
+    if (!_mm256_testz_si256(
+          _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(src + 4 * i - 32)),
+          alpha)) {
+      break;
+    }
+  }
+  return argb32_end_drawn_sse41(src, i);
+}
+
+TARGET("avx512f,avx512bw") size_t argb32_first_drawn_avx512(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm512_set1_epi32(int(0xff000000));
+  auto i = size_t{};
+  for (; i + 16 <= n; i += 16) {
+    if (_mm512_test_epi32_mask(_mm512_loadu_si512(src + 4 * i), alpha)) {
+      break;
+    }
+  }
+  return i + argb32_first_drawn_avx2(src + 4 * i, n - i);
+}
+
+TARGET("avx512f,avx512bw") size_t argb32_end_drawn_avx512(
+  uint8_t const* src, size_t n)
+{
+  auto const& alpha = _mm512_set1_epi32(int(0xff000000));
+  auto i = n;
+  for (; i >= 16; i -= 16) {
+    if (_mm512_test_epi32_mask(
+          _mm512_loadu_si512(src + 4 * i - 64), alpha)) {
+      break;
+    }
+  }
+  return argb32_end_drawn_avx2(src, i);
+}
+
+// Gradient compositing kernels.  The gradient is evaluated as color + i * step
+// for each pixel (rather than accumulated), so that long spans do not drift.
+// Unlike the integer kernels above, these may differ from the scalar one by
+// rounding (e.g. where the compiler fuses multiplies and adds); the tails are
+// handed to the next narrower kernel.
+
+// Offset the start of a gradient by i pixels, to pass the remainder of a span
+// to a narrower kernel.
+std::array<float, 4> gradient_at(
+  float const* color, float const* step, size_t i)
+{
+  return {color[0] + float(i) * step[0], color[1] + float(i) * step[1],
+          color[2] + float(i) * step[2], color[3] + float(i) * step[3]};
+}
+
+TARGET("sse4.1") void rgba128f_over_gradient_sse41(
+  float* dst, float const* color, float const* step, size_t n)
+{
+  auto const& c0 = _mm_loadu_ps(color), & dc = _mm_loadu_ps(step),
+            & one = _mm_set1_ps(1);
+  auto k = _mm_setzero_ps();
+  for (auto i = size_t{}; i < n; ++i, k = _mm_add_ps(k, one)) {
+    auto const& c = _mm_add_ps(c0, _mm_mul_ps(k, dc));
+    auto const& t = _mm_sub_ps(one, _mm_shuffle_ps(c, c, 0xff));
+    _mm_storeu_ps(
+      dst + 4 * i, _mm_add_ps(c, _mm_mul_ps(_mm_loadu_ps(dst + 4 * i), t)));
+  }
+}
+
+TARGET("avx2") void rgba128f_over_gradient_avx2(
+  float* dst, float const* color, float const* step, size_t n)
+{
+  auto const& c0 = _mm256_broadcast_ps(reinterpret_cast<__m128 const*>(color)),
+            & dc = _mm256_broadcast_ps(reinterpret_cast<__m128 const*>(step)),
+            & one = _mm256_set1_ps(1), & two = _mm256_set1_ps(2);
+  auto k = _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1);
+  auto i = size_t{};
+  for (; i + 2 <= n; i += 2, k = _mm256_add_ps(k, two)) {
+    auto const& c = _mm256_add_ps(c0, _mm256_mul_ps(k, dc));
+    auto const& t = _mm256_sub_ps(one, _mm256_permute_ps(c, 0xff));
+    _mm256_storeu_ps(
+      dst + 4 * i,
+      _mm256_add_ps(c, _mm256_mul_ps(_mm256_loadu_ps(dst + 4 * i), t)));
+  }
+  auto const& rest = gradient_at(color, step, i);
+  rgba128f_over_gradient_sse41(dst + 4 * i, rest.data(), step, n - i);
+}
+
+TARGET("avx512f,avx512bw") void rgba128f_over_gradient_avx512(
+  float* dst, float const* color, float const* step, size_t n)
+{
+  auto const& c0 = _mm512_broadcast_f32x4(_mm_loadu_ps(color)),
+            & dc = _mm512_broadcast_f32x4(_mm_loadu_ps(step)),
+            & one = _mm512_set1_ps(1), & four = _mm512_set1_ps(4);
+  auto k = _mm512_setr_ps(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+  auto i = size_t{};
+  for (; i + 4 <= n; i += 4, k = _mm512_add_ps(k, four)) {
+    auto const& c = _mm512_add_ps(c0, _mm512_mul_ps(k, dc));
+    auto const& t = _mm512_sub_ps(one, _mm512_permute_ps(c, 0xff));
+    _mm512_storeu_ps(
+      dst + 4 * i,
+      _mm512_add_ps(c, _mm512_mul_ps(_mm512_loadu_ps(dst + 4 * i), t)));
+  }
+  auto const& rest = gradient_at(color, step, i);
+  rgba128f_over_gradient_avx2(dst + 4 * i, rest.data(), step, n - i);
+}
+
+#undef SWAP_RB_MASK
+#undef TARGET
+
+struct CpuFeatures {
+  bool sse41, avx2, avx512bw;
+};
+
+CpuFeatures detect_cpu_features()
+{
+#if defined __GNUC__ || defined __clang__
+  __builtin_cpu_init();
+  return {
+    bool(__builtin_cpu_supports("sse4.1")),
+    bool(__builtin_cpu_supports("avx2")),
+    __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")};
+#else
+  // Also check that the OS saves the AVX (and AVX-512) registers.
+  int regs[4];
+  __cpuid(regs, 0);
+  auto const& max_leaf = regs[0];
+  __cpuid(regs, 1);
+  auto const& sse41 = bool(regs[2] & (1 << 19)),
+              osxsave = bool(regs[2] & (1 << 27)),
+              avx = bool(regs[2] & (1 << 28));
+  auto const& xcr0 = osxsave ? _xgetbv(0) : 0;
+  auto ebx7 = 0;
+  if (max_leaf >= 7) {
+    __cpuidex(regs, 7, 0);
+    ebx7 = regs[1];
+  }
+  return {
+    sse41,
+    avx && (xcr0 & 0x06) == 0x06 && (ebx7 & (1 << 5)),
+    (xcr0 & 0xe6) == 0xe6 && (ebx7 & (1 << 16)) && (ebx7 & (1 << 30))};
+#endif
+}
+
+#endif
+
+struct Kernels {
+  std::string name;
+  decltype(argb32_to_premultiplied_rgba8888) to_premultiplied;
+  decltype(argb32_to_straight_rgba8888) to_straight;
+  decltype(rgba128f_to_argb32) from_float;
+  decltype(straight_rgba8888_to_argb32) from_straight;
+  decltype(argb32_first_drawn) first_drawn;
+  decltype(argb32_end_drawn) end_drawn;
+  decltype(rgba128f_over_gradient) over_gradient;
+};
+
+std::vector<Kernels> const& available_kernels()
+{
+  static auto const& kernels = [] {
+    auto kernels = std::vector<Kernels>{
+      {"none",
+       argb32_to_premultiplied_rgba8888_scalar,
+       argb32_to_straight_rgba8888_scalar,
+       rgba128f_to_argb32_scalar,
+       straight_rgba8888_to_argb32_scalar,
+       argb32_first_drawn_scalar,
+       argb32_end_drawn_scalar,
+       rgba128f_over_gradient_scalar}};
+#ifdef MPLCAIRO_X86
+    auto const& features = detect_cpu_features();
+    if (features.sse41) {
+      kernels.push_back({"sse4.1",
+                         argb32_to_premultiplied_rgba8888_sse41,
+                         argb32_to_straight_rgba8888_sse41,
+                         rgba128f_to_argb32_sse41,
+                         straight_rgba8888_to_argb32_sse41,
+                         argb32_first_drawn_sse41,
+                         argb32_end_drawn_sse41,
+                         rgba128f_over_gradient_sse41});
+    }
+    if (features.sse41 && features.avx2) {
+      kernels.push_back({"avx2",
+                         argb32_to_premultiplied_rgba8888_avx2,
+                         argb32_to_straight_rgba8888_avx2,
+                         rgba128f_to_argb32_avx2,
+                         straight_rgba8888_to_argb32_avx2,
+                         argb32_first_drawn_avx2,
+                         argb32_end_drawn_avx2,
+                         rgba128f_over_gradient_avx2});
+    }
+    if (features.sse41 && features.avx2 && features.avx512bw) {
+      kernels.push_back({"avx512",
+                         argb32_to_premultiplied_rgba8888_avx512,
+                         argb32_to_straight_rgba8888_avx512,
+                         rgba128f_to_argb32_avx512,
+                         straight_rgba8888_to_argb32_avx512,
+                         argb32_first_drawn_avx512,
+                         argb32_end_drawn_avx512,
+                         rgba128f_over_gradient_avx512});
+    }
+#endif
+    return kernels;
+  }();
+  return kernels;
+}
+
+std::string current_simd{"none"};
+
+}
+
+decltype(argb32_to_premultiplied_rgba8888) argb32_to_premultiplied_rgba8888{
+  argb32_to_premultiplied_rgba8888_scalar};
+decltype(argb32_to_straight_rgba8888) argb32_to_straight_rgba8888{
+  argb32_to_straight_rgba8888_scalar};
+decltype(rgba128f_to_argb32) rgba128f_to_argb32{rgba128f_to_argb32_scalar};
+decltype(straight_rgba8888_to_argb32) straight_rgba8888_to_argb32{
+  straight_rgba8888_to_argb32_scalar};
+decltype(argb32_first_drawn) argb32_first_drawn{argb32_first_drawn_scalar};
+decltype(argb32_end_drawn) argb32_end_drawn{argb32_end_drawn_scalar};
+decltype(rgba128f_over_gradient) rgba128f_over_gradient{
+  rgba128f_over_gradient_scalar};
+
+// Float surfaces are rare enough not to warrant SIMD variants.
+
+size_t rgba128f_first_drawn(float const* src, size_t n)
+{
+  auto i = size_t{};
+  for (; i < n && !src[4 * i + 3]; ++i) {}
+  return i;
+}
+
+size_t rgba128f_end_drawn(float const* src, size_t n)
+{
+  auto i = n;
+  for (; i && !src[4 * i - 1]; --i) {}
+  return i;
+}
+
+std::vector<std::string> const& available_simd()
+{
+  static auto const& names = [] {
+    auto names = std::vector<std::string>{};
+    for (auto const& kernels: available_kernels()) {
+      names.push_back(kernels.name);
+    }
+    return names;
+  }();
+  return names;
+}
+
+std::string get_simd()
+{
+  return current_simd;
+}
+
+void set_simd(std::string simd)
+{
+  auto const& kernels = available_kernels();
+  auto const& it = std::find_if(
+    kernels.begin(), kernels.end(),
+    [&](Kernels const& k) { return k.name == simd; });
+  if (it == kernels.end()) {
+    throw std::invalid_argument{
+      "unsupported SIMD instruction set: {} (available: {})"_format(
+        simd, available_simd()).cast<std::string>()};
+  }
+  argb32_to_premultiplied_rgba8888 = it->to_premultiplied;
+  argb32_to_straight_rgba8888 = it->to_straight;
+  rgba128f_to_argb32 = it->from_float;
+  straight_rgba8888_to_argb32 = it->from_straight;
+  argb32_first_drawn = it->first_drawn;
+  argb32_end_drawn = it->end_drawn;
+  rgba128f_over_gradient = it->over_gradient;
+  current_simd = simd;
+}
+
+}
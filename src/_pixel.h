@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mplcairo::pixel {
+
+// Pixel format conversion kernels, each converting n contiguous pixels.  The
+// source and destination may be identical (for in-place conversion), but must
+// not otherwise overlap.  "argb32" refers to cairo's native-endian ARGB32, and
+// "rgba128f" to cairo's RGBA128F; "rgba8888" is bytewise.
+
+extern void (*argb32_to_premultiplied_rgba8888)(
+  uint8_t const* src, uint8_t* dst, size_t n);
+extern void (*argb32_to_straight_rgba8888)(
+  uint8_t const* src, uint8_t* dst, size_t n);
+extern void (*rgba128f_to_argb32)(float const* src, uint8_t* dst, size_t n);
+extern void (*straight_rgba8888_to_argb32)(
+  uint8_t const* src, uint8_t* dst, size_t n);
+
+// Drawn-region scanning kernels, over n contiguous pixels: "first_drawn"
+// returns the index of the first pixel with a nonzero alpha (or n), and
+// "end_drawn" one past the index of the last such pixel (or 0).
+
+extern size_t (*argb32_first_drawn)(uint8_t const* src, size_t n);
+extern size_t (*argb32_end_drawn)(uint8_t const* src, size_t n);
+size_t rgba128f_first_drawn(float const* src, size_t n);
+size_t rgba128f_end_drawn(float const* src, size_t n);
+
+// Gradient compositing kernel: composite (OVER) the premultiplied RGBA float
+// colors color + i * step (for i in [0, n)) onto n contiguous pixels of dst,
+// also premultiplied RGBA floats (as cairo's RGBA128F).
+
+extern void (*rgba128f_over_gradient)(
+  float* dst, float const* color, float const* step, size_t n);
+
+// The instruction sets for which kernels are available (on this CPU), in
+// increasing order of preference; the first one is always "none".
+std::vector<std::string> const& available_simd();
+// Get or set the instruction set used by the kernels; set_simd selects the
+// best available one by default at import time.
+std::string get_simd();
+void set_simd(std::string simd);
+
+}
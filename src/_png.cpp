@@ -0,0 +1,527 @@
+#include "_png.h"
+
+#include "_pixel.h"
+#include "_thread_pool.h"
+#include "_util.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#ifdef MPLCAIRO_USE_ZLIB
+#include <zlib.h>
+
+namespace mplcairo {
+
+using namespace pybind11::literals;
+
+namespace {
+
+enum class png_filter_t { none, sub, up, average, paeth, adaptive };
+
+size_t const idat_size = size_t{1} << 16,
+             segment_size = size_t{1} << 17,  // As in pigz.
+             window_size = size_t{1} << 15;
+
+void store_be32(uint8_t* ptr, uint32_t value)
+{
+  ptr[0] = value >> 24;
+  ptr[1] = value >> 16;
+  ptr[2] = value >> 8;
+  ptr[3] = value;
+}
+
+// Must be called with the GIL held.
+void write_chunk(
+  py::handle file, char const* type, uint8_t const* data, size_t size)
+{
+  auto const& chunk = py::reinterpret_steal<py::bytes>(
+    PyBytes_FromStringAndSize(nullptr, 12 + size));
+  if (!chunk) {
+    throw py::error_already_set{};
+  }
+  auto const& ptr =
+    reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(chunk.ptr()));
+  store_be32(ptr, size);
+  std::memcpy(ptr + 4, type, 4);
+  if (size) {
+    std::memcpy(ptr + 8, data, size);
+  }
+  store_be32(ptr + 8 + size, crc32(0, ptr + 4, 4 + size));
+  file.attr("write")(chunk);
+}
+
+uint8_t paeth_predictor(int a, int b, int c)
+{
+  auto const& p = a + b - c;
+  auto const& pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Write the filter type byte followed by the filtered row (of n bytes, with 4
+// bytes per pixel) to out; prev is the previous (unfiltered) row, or zeros.
+void filter_row(
+  png_filter_t filter, uint8_t const* cur, uint8_t const* prev,
+  uint8_t* out, size_t n)
+{
+  *out++ = uint8_t(filter);
+  auto const& m = size_t(std::min<size_t>(4, n));
+  switch (filter) {
+    case png_filter_t::none:
+      std::memcpy(out, cur, n);
+      break;
+    case png_filter_t::sub:
+      std::memcpy(out, cur, m);
+      for (auto i = m; i < n; ++i) {
+        out[i] = cur[i] - cur[i - 4];
+      }
+      break;
+    case png_filter_t::up:
+      for (auto i = size_t{0}; i < n; ++i) {
+        out[i] = cur[i] - prev[i];
+      }
+      break;
+    case png_filter_t::average:
+      for (auto i = size_t{0}; i < m; ++i) {
+        out[i] = cur[i] - (prev[i] >> 1);
+      }
+      for (auto i = m; i < n; ++i) {
+        out[i] = cur[i] - ((cur[i - 4] + prev[i]) >> 1);
+      }
+      break;
+    case png_filter_t::paeth:
+      for (auto i = size_t{0}; i < m; ++i) {
+        out[i] = cur[i] - prev[i];
+      }
+      for (auto i = m; i < n; ++i) {
+        out[i] = cur[i] - paeth_predictor(cur[i - 4], prev[i], prev[i - 4]);
+      }
+      break;
+    case png_filter_t::adaptive:
+      throw std::logic_error{"adaptive is not a filter type"};
+  }
+}
+
+// The "minimum sum of absolute differences" heuristic (as used by libpng):
+// the filtered bytes are interpreted as signed.
+uint64_t filter_cost(uint8_t const* filtered, size_t n)
+{
+  auto cost = uint64_t{};
+  for (auto i = size_t{0}; i < n; ++i) {
+    cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+  }
+  return cost;
+}
+
+png_filter_t parse_filter(std::string const& filter)
+{
+  if (filter == "none") {
+    return png_filter_t::none;
+  } else if (filter == "sub") {
+    return png_filter_t::sub;
+  } else if (filter == "up") {
+    return png_filter_t::up;
+  } else if (filter == "average") {
+    return png_filter_t::average;
+  } else if (filter == "paeth") {
+    return png_filter_t::paeth;
+  } else if (filter == "adaptive") {
+    return png_filter_t::adaptive;
+  } else {
+    throw std::invalid_argument{
+      "invalid PNG filter: {!r}"_format(filter).cast<std::string>()};
+  }
+}
+
+// Encode a metadata entry as the payload of a tEXt chunk or, if the text is
+// not representable in latin-1, of an (uncompressed) iTXt chunk.  Must be
+// called with the GIL held.
+std::pair<char const*, std::string> text_chunk(py::str key, py::str value)
+{
+  auto keyword = std::string{};
+  try {
+    keyword = key.attr("encode")("latin-1").cast<std::string>();
+  } catch (py::error_already_set& e) {
+    if (!e.matches(PyExc_UnicodeEncodeError)) {
+      throw;
+    }
+  }
+  if (keyword.empty() || keyword.size() > 79
+      || keyword.find('\0') != keyword.npos) {
+    throw std::invalid_argument{
+      "invalid PNG metadata key (must be 1 to 79 latin-1 characters): "
+      "{!r}"_format(key).cast<std::string>()};
+  }
+  try {
+    return {
+      "tEXt",
+      keyword + '\0' + value.attr("encode")("latin-1").cast<std::string>()};
+  } catch (py::error_already_set& e) {
+    if (!e.matches(PyExc_UnicodeEncodeError)) {
+      throw;
+    }
+    // Keyword, compression flag & method, (empty) language tag & translated
+    // keyword, text.
+    return {
+      "iTXt",
+      keyword + std::string{"\0\0\0\0\0", 5}
+      + value.attr("encode")("utf-8").cast<std::string>()};
+  }
+}
+
+// Filter n_rows contiguous rows into out (which must have room for
+// n_rows * (1 + row_size) bytes); prev is the row preceding the first one, or
+// zeros.  The choice of filter for a row only depends on that row and the
+// previous one.
+void filter_rows(
+  png_filter_t filter, uint8_t const* rows, uint8_t const* prev,
+  size_t n_rows, size_t row_size, uint8_t* out)
+{
+  auto candidates = std::vector<uint8_t>(
+    filter == png_filter_t::adaptive ? 5 * (1 + row_size) : 0);
+  for (auto j = size_t{0}; j < n_rows; ++j, out += 1 + row_size) {
+    auto const& cur = rows + j * row_size;
+    if (j) {
+      prev = cur - row_size;
+    }
+    if (filter != png_filter_t::adaptive) {
+      filter_row(filter, cur, prev, out, row_size);
+      continue;
+    }
+    auto best = candidates.data();
+    auto best_cost = std::numeric_limits<uint64_t>::max();
+    for (auto k = 0; k < 5; ++k) {
+      auto const& candidate = candidates.data() + k * (1 + row_size);
+      filter_row(png_filter_t(k), cur, prev, candidate, row_size);
+      if (auto const& cost = filter_cost(candidate + 1, row_size);
+          cost < best_cost) {
+        best = candidate;
+        best_cost = cost;
+      }
+    }
+    std::memcpy(out, best, 1 + row_size);
+  }
+}
+
+using z_stream_ptr = std::unique_ptr<z_stream, decltype(&deflateEnd)>;
+
+// Initialize *z (for a raw deflate stream if raw is set, otherwise for a zlib
+// stream) and return a guard that ends it.
+z_stream_ptr init_deflate(
+  z_stream& z, int compress_level, png_filter_t filter, bool raw)
+{
+  z = z_stream{};
+  if (auto const& ret = deflateInit2(
+        &z, compress_level, Z_DEFLATED, raw ? -15 : 15, 8,
+        filter == png_filter_t::none ? Z_DEFAULT_STRATEGY : Z_FILTERED);
+      ret != Z_OK) {
+    // Not _format: may be called without the GIL.
+    throw std::runtime_error{
+      "deflateInit2 failed with error " + std::to_string(ret)};
+  }
+  return {&z, deflateEnd};
+}
+
+// Compress size bytes from data, passing the output to sink(ptr, size).
+template<typename Sink>
+void compress(
+  z_stream& z, uint8_t const* data, size_t size, int flush, Sink const& sink)
+{
+  auto out = std::vector<uint8_t>(size_t{1} << 14);
+  z.next_in = const_cast<Bytef*>(data);
+  z.avail_in = size;
+  do {
+    z.next_out = out.data();
+    z.avail_out = out.size();
+    if (deflate(&z, flush) == Z_STREAM_ERROR) {
+      throw std::runtime_error{"deflate failed"};
+    }
+    sink(out.data(), out.size() - z.avail_out);
+  } while (!z.avail_out);
+}
+
+// Buffers the compressed stream and writes it as IDAT chunks, acquiring the
+// GIL to do so.
+class IdatWriter {
+  py::handle file_;
+  std::vector<uint8_t> buf_;
+  size_t size_;
+
+  public:
+  IdatWriter(py::handle file) : file_{file}, buf_(idat_size), size_{} {}
+
+  void write(uint8_t const* data, size_t size)
+  {
+    while (size) {
+      auto const n = std::min(size, idat_size - size_);
+      std::memcpy(buf_.data() + size_, data, n);
+      size_ += n;
+      data += n;
+      size -= n;
+      if (size_ == idat_size) {
+        flush();
+      }
+    }
+  }
+
+  void flush()
+  {
+    if (size_) {
+      auto const& gil = py::gil_scoped_acquire{};
+      write_chunk(file_, "IDAT", buf_.data(), size_);
+      size_ = 0;
+    }
+  }
+};
+
+}
+
+void write_png(
+  std::variant<py::array_t<uint8_t, py::array::c_style>,
+               py::array_t<float, py::array::c_style>> buf,
+  py::object file, int compress_level, std::string filter,
+  py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+  std::optional<int> threads)
+{
+  auto const& source = std::visit([&](auto const& buf) {
+    if (buf.ndim() != 3 || buf.shape(2) != 4) {
+      throw std::invalid_argument{
+        "buffer must have shape (height, width, 4), not {.shape}"_format(buf)
+        .cast<std::string>()};
+    }
+    using T = typename std::decay_t<decltype(buf)>::value_type;
+    auto const& width = size_t(buf.shape(1));
+    auto const& data = buf.data();
+    auto source = RowSource{size_t(buf.shape(1)), size_t(buf.shape(0))};
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      source.convert = [=](size_t start, size_t stop, uint8_t* dst) {
+        pixel::argb32_to_straight_rgba8888(
+          data + 4 * width * start, dst, width * (stop - start));
+      };
+    } else {
+      source.convert = [=](size_t start, size_t stop, uint8_t* dst) {
+        pixel::rgba128f_to_argb32(
+          data + 4 * width * start, dst, width * (stop - start));
+        pixel::argb32_to_straight_rgba8888(dst, dst, width * (stop - start));
+      };
+    }
+    return source;
+  }, buf);
+  write_png_rows(
+    source, file, compress_level, filter, metadata, dpi, threads);
+}
+
+void write_png_rows(
+  RowSource const& source,
+  py::object file, int compress_level, std::string filter_s,
+  py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+  std::optional<int> threads)
+{
+  if (compress_level < -1 || compress_level > 9) {
+    throw std::invalid_argument{
+      "compress_level must be between -1 and 9, not {}"_format(compress_level)
+      .cast<std::string>()};
+  }
+  auto const& filter = parse_filter(filter_s);
+  // Not structured bindings, which lambdas cannot capture.
+  auto const& width = source.width, & height = source.height;
+  auto const& convert = source.convert;
+  auto const& min_block_rows = source.block_rows;
+  auto const& prefetch = source.prefetch;
+  if (!height || !width || height > 0x7fffffff || width > 0x7fffffff) {
+    throw std::invalid_argument{
+      "cannot write a {}x{} image as PNG"_format(width, height)
+      .cast<std::string>()};
+  }
+  auto texts = std::vector<std::pair<char const*, std::string>>{};
+  for (auto const& [key, value]: metadata) {
+    if (!value.is_none()) {
+      texts.push_back(text_chunk(key.cast<py::str>(), value.cast<py::str>()));
+    }
+  }
+
+  file.attr("write")(py::bytes{"\x89PNG\r\n\x1a\n"});
+  auto ihdr = std::array<uint8_t, 13>{};
+  store_be32(ihdr.data(), width);
+  store_be32(ihdr.data() + 4, height);
+  ihdr[8] = 8;  // Bit depth.
+  ihdr[9] = 6;  // Color type: RGBA.  Compression, filter, interlace: 0.
+  write_chunk(file, "IHDR", ihdr.data(), ihdr.size());
+  if (dpi) {
+    auto phys = std::array<uint8_t, 9>{};
+    auto const& [dpi_x, dpi_y] = *dpi;
+    store_be32(phys.data(), uint32_t(dpi_x / .0254 + .5));
+    store_be32(phys.data() + 4, uint32_t(dpi_y / .0254 + .5));
+    phys[8] = 1;  // Unit: meter.
+    write_chunk(file, "pHYs", phys.data(), phys.size());
+  }
+  for (auto const& [type, payload]: texts) {
+    write_chunk(
+      file, type, reinterpret_cast<uint8_t const*>(payload.data()),
+      payload.size());
+  }
+
+  auto const& row_size = 4 * width;
+  auto idat = IdatWriter{file};
+  auto const& nogil = py::gil_scoped_release{};
+
+  auto const& n_threads = threads.value_or(detail::PNG_THREADS);
+  auto const& segment_rows = size_t(
+    std::max({segment_size / (1 + row_size), min_block_rows, size_t{1}}));
+  if (auto const& n_segments = (height + segment_rows - 1) / segment_rows;
+      n_threads > 1 && n_segments > 1) {
+    // pigz-style: segments of rows are converted, filtered and compressed
+    // independently (each one primed with the preceding 32 kB of filtered
+    // data, which it recomputes), as raw deflate streams ending on a byte
+    // boundary, which are concatenated into a single zlib stream.
+    auto const& dict_rows = (window_size + row_size) / (1 + row_size);
+    struct Segment {
+      std::vector<uint8_t> data;
+      uLong adler;
+      size_t size;
+    };
+    auto const& compress_segment = [&, segment_rows, dict_rows](
+      size_t start, Segment& segment
+    ) {
+      auto const& stop = size_t(std::min(height, start + segment_rows));
+      auto const& first = start - std::min(start, dict_rows);
+      auto const& has_prev = first > 0;
+      auto rows = std::vector<uint8_t>((stop - first + has_prev) * row_size);
+      convert(first - has_prev, stop, rows.data());
+      auto filtered = std::vector<uint8_t>((stop - first) * (1 + row_size));
+      auto const& zeros = std::vector<uint8_t>(has_prev ? 0 : row_size);
+      filter_rows(
+        filter, rows.data() + has_prev * row_size,
+        has_prev ? rows.data() : zeros.data(), stop - first, row_size,
+        filtered.data());
+      auto const& dict_size = (start - first) * (1 + row_size);
+      auto const& data = filtered.data() + dict_size;
+      segment.size = filtered.size() - dict_size;
+      segment.adler = adler32(adler32(0, nullptr, 0), data, segment.size);
+      auto z = z_stream{};
+      auto const& z_guard = init_deflate(z, compress_level, filter, true);
+      if (dict_size) {
+        auto const& n = std::min(dict_size, window_size);
+        deflateSetDictionary(&z, data - n, n);
+      }
+      compress(
+        z, data, segment.size, stop == height ? Z_FINISH : Z_SYNC_FLUSH,
+        [&](uint8_t const* ptr, size_t size) {
+          segment.data.insert(segment.data.end(), ptr, ptr + size);
+        });
+    };
+
+    // zlib header: deflate with a 32 kB window, no preset dictionary, and a
+    // level hint (see RFC1950).
+    auto const& level = compress_level == -1 ? 6 : compress_level;
+    auto const& level_hint =
+      level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    auto header = std::array<uint8_t, 2>{0x78, uint8_t(level_hint << 6)};
+    header[1] += 31 - (header[0] * 256 + header[1]) % 31;
+    idat.write(header.data(), header.size());
+    // Keep at most 2 * threads segments in flight, to bound memory use.
+    auto pending =
+      std::deque<std::pair<std::future<void>, std::unique_ptr<Segment>>>{};
+    try {
+      auto adler = adler32(0, nullptr, 0);
+      for (auto start = size_t{0}, i = size_t{0}; i < n_segments; ++i) {
+        for (; start < height && pending.size() < 2 * size_t(n_threads);
+             start += segment_rows) {
+          auto segment = std::make_unique<Segment>();
+          auto future = ThreadPool::get().submit(
+            [&, start, ptr = segment.get()] {
+              compress_segment(start, *ptr);
+            });
+          pending.emplace_back(std::move(future), std::move(segment));
+        }
+        auto [future, segment] = std::move(pending.front());
+        pending.pop_front();
+        future.get();
+        idat.write(segment->data.data(), segment->data.size());
+        adler = adler32_combine(adler, segment->adler, segment->size);
+      }
+      auto trailer = std::array<uint8_t, 4>{};
+      store_be32(trailer.data(), adler);
+      idat.write(trailer.data(), trailer.size());
+    } catch (...) {
+      for (auto& [future, segment]: pending) {
+        (void)segment;
+        future.wait();  // The tasks refer to local variables.
+      }
+      throw;
+    }
+  } else {
+    // Rows are converted in blocks (of at least ~64 kB) into a ring buffer;
+    // the next block(s) are converted by the thread pool while the current
+    // one is filtered and compressed.
+    auto z = z_stream{};
+    auto const& z_guard = init_deflate(z, compress_level, filter, false);
+    auto const& sink = [&](uint8_t const* ptr, size_t size) {
+      idat.write(ptr, size);
+    };
+    auto const& block_rows =
+      size_t(std::max({idat_size / row_size, min_block_rows, size_t{1}}));
+    auto const& n_blocks = (height + block_rows - 1) / block_rows;
+    auto const& n_prefetch =
+      detail::CONVERSION_THREADS > 1 && n_blocks > 1 ? prefetch : 0;
+    auto blocks = std::vector<std::vector<uint8_t>>(
+      n_prefetch + 1, std::vector<uint8_t>(block_rows * row_size));
+    auto prev = std::vector<uint8_t>(row_size);  // Zero for the first row.
+    auto filtered = std::vector<uint8_t>(block_rows * (1 + row_size));
+    auto const& convert_block = [&](size_t i) {
+      convert(
+        i * block_rows, std::min(height, (i + 1) * block_rows),
+        blocks[i % blocks.size()].data());
+    };
+    auto pending = std::deque<std::future<void>>{};
+    try {
+      for (auto i = size_t{0}, next = size_t{0}; i < n_blocks; ++i) {
+        // Block i + n_prefetch overwrites block i - 1, whose last row has
+        // already been copied to prev.
+        for (; next < n_blocks && next <= i + n_prefetch; ++next) {
+          if (n_prefetch) {
+            pending.push_back(
+              ThreadPool::get().submit([&, next] { convert_block(next); }));
+          } else {
+            convert_block(next);
+          }
+        }
+        if (n_prefetch) {
+          auto future = std::move(pending.front());
+          pending.pop_front();
+          future.get();
+        }
+        auto const& rows = blocks[i % blocks.size()].data();
+        auto const& n_rows =
+          size_t(std::min(height - i * block_rows, block_rows));
+        filter_rows(
+          filter, rows, prev.data(), n_rows, row_size, filtered.data());
+        std::memcpy(prev.data(), rows + (n_rows - 1) * row_size, row_size);
+        compress(
+          z, filtered.data(), n_rows * (1 + row_size), Z_NO_FLUSH, sink);
+      }
+      compress(z, nullptr, 0, Z_FINISH, sink);
+    } catch (...) {
+      for (auto& future: pending) {
+        future.wait();  // The tasks refer to the blocks.
+      }
+      throw;
+    }
+  }
+
+  idat.flush();
+  auto const& gil = py::gil_scoped_acquire{};
+  write_chunk(file, "IEND", nullptr, 0);
+}
+
+}
+#endif
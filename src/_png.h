@@ -0,0 +1,49 @@
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <variant>
+
+namespace mplcairo {
+
+namespace py = pybind11;
+
+// A source of straight RGBA8888 rows, for write_png_rows.
+struct RowSource {
+  size_t width, height;
+  // Fill dst with rows [start, stop).  May be called concurrently from
+  // multiple threads, without the GIL.
+  std::function<void(size_t, size_t, uint8_t*)> convert;
+  // Rows are requested in blocks of at least block_rows rows (except at the
+  // end), and up to prefetch blocks may be requested ahead of compression.
+  size_t block_rows = 1, prefetch = 1;
+};
+
+// Write a cairo ARGB32 (premultiplied) or RGBA128F buffer as a straight RGBA
+// PNG to a binary file-like object.  Rows are converted and filtered a few at
+// a time, so that (beyond the output chunks) memory use is O(width); the
+// conversion of the next rows overlaps with the compression of the current
+// ones.  Each value of *metadata* (None values are skipped) is written as a
+// tEXt chunk, or as an iTXt chunk if it is not representable in latin-1.
+// With more than one thread (defaulting to the png_threads option), the image
+// is instead split into segments compressed in parallel.  write_png_rows is
+// the same, but writes rows produced on demand by *source*.
+void write_png(
+  std::variant<py::array_t<uint8_t, py::array::c_style>,
+               py::array_t<float, py::array::c_style>> buf,
+  py::object file, int compress_level, std::string filter,
+  py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+  std::optional<int> threads);
+void write_png_rows(
+  RowSource const& source,
+  py::object file, int compress_level, std::string filter,
+  py::dict metadata, std::optional<std::tuple<double, double>> dpi,
+  std::optional<int> threads);
+
+}
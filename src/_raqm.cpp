@@ -2,7 +2,9 @@
 
 #include "_os.h"
 
+#include <mutex>
 #include <stdexcept>
+#include <vector>
 
 #include "_macros.h"
 
@@ -11,6 +13,11 @@ namespace mplcairo {
 namespace raqm {
 namespace {
 os::library_t _handle;
+// Shared by all threads, rather than thread-local, so that it can be drained
+// before raqm is unloaded.
+std::mutex _pool_mutex;
+std::vector<raqm_t*> _pool;
+size_t const _max_pool_size = 64;
 }
 }
 
@@ -19,6 +26,7 @@ ITER_RAQM_API(DEFINE_API)
 #undef DEFINE_API
 bool bad_color_glyph_spacing{};
 decltype(hb::version_string) hb::version_string{};
+decltype(raqm::clear_contents) raqm::clear_contents{};
 
 void load_raqm() {
   if (!raqm::_handle) {
@@ -58,11 +66,21 @@ void load_raqm() {
     // check that at the call site.
     hb::version_string = reinterpret_cast<decltype(hb::version_string)>(
       os::dlsym(raqm::_handle, "hb_version_string"));
+    raqm::clear_contents = reinterpret_cast<decltype(raqm::clear_contents)>(
+      os::dlsym(raqm::_handle, "raqm_clear_contents"));
   }
 }
 
 void unload_raqm() {
   if (raqm::_handle) {
+    {
+      auto const& lock = std::lock_guard{raqm::_pool_mutex};
+      for (auto const& rq: raqm::_pool) {
+        raqm::destroy(rq);
+      }
+      raqm::_pool.clear();
+    }
+    raqm::clear_contents = nullptr;
     auto const& error = os::dlclose(raqm::_handle);
     raqm::_handle = nullptr;
     if (error) {
@@ -75,4 +93,31 @@ bool has_raqm() {
   return raqm::_handle;
 }
 
+raqm_t* raqm::acquire() {
+  if (clear_contents) {
+    auto const& lock = std::lock_guard{_pool_mutex};
+    if (_pool.size()) {
+      auto const& rq = _pool.back();
+      _pool.pop_back();
+      return rq;
+    }
+  }
+  return create();
+}
+
+void raqm::release(raqm_t* rq) {
+  if (!rq) {
+    return;
+  }
+  if (clear_contents) {
+    clear_contents(rq);
+    auto const& lock = std::lock_guard{_pool_mutex};
+    if (_pool.size() < _max_pool_size) {
+      _pool.push_back(rq);
+      return;
+    }
+  }
+  destroy(rq);
+}
+
 }
@@ -32,6 +32,14 @@ ITER_RAQM_API(DECLARE_API)
 
 bool bad_color_glyph_spacing;
 
+// Only available with raqm>=0.10; nullptr otherwise.
+extern void (*clear_contents)(raqm_t*);
+
+// Get a context from the pool (or create one), and return it to the pool
+// (or destroy it).  Contexts can only be reused if clear_contents is available.
+raqm_t* acquire();
+void release(raqm_t* rq);
+
 }
 
 namespace hb {
@@ -0,0 +1,136 @@
+#include "_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+namespace mplcairo {
+
+namespace {
+thread_local bool is_worker{};
+
+long current_pid()
+{
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+}
+
+ThreadPool::ThreadPool() : n_workers_{}, n_idle_{}, pid_{current_pid()}
+{}
+
+ThreadPool& ThreadPool::get()
+{
+  // Pools are never destroyed: worker threads are detached and may still be
+  // waiting on the condition variable at process exit, and, after a fork, the
+  // parent's pool (whose mutex may even have been held by another thread at
+  // fork time) is simply abandoned.
+  static auto pool = std::atomic<ThreadPool*>{};
+  auto current = pool.load();
+  while (!current || current->pid_ != current_pid()) {
+    auto const& fresh = new ThreadPool{};
+    if (pool.compare_exchange_strong(current, fresh)) {
+      current = fresh;
+    } else {
+      delete fresh;
+    }
+  }
+  return *current;
+}
+
+bool ThreadPool::in_worker()
+{
+  return is_worker;
+}
+
+void ThreadPool::ensure_workers(size_t n)
+{
+  // Must be called with mutex_ held.
+  for (; n_workers_ < n; ++n_workers_) {
+    std::thread{[this] { work(); }}.detach();
+  }
+}
+
+void ThreadPool::work()
+{
+  is_worker = true;
+  auto lock = std::unique_lock{mutex_};
+  while (true) {
+    ++n_idle_;
+    cv_.wait(lock, [&] { return tasks_.size(); });
+    --n_idle_;
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();  // Exceptions are stored in the task's future.
+    lock.lock();
+  }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+  auto const& packaged =
+    std::make_shared<std::packaged_task<void()>>(std::move(task));
+  auto future = packaged->get_future();
+  {
+    auto const& lock = std::lock_guard{mutex_};
+    tasks_.emplace_back([packaged] { (*packaged)(); });
+    if (n_idle_ < tasks_.size()) {
+      auto const& max_workers =
+        size_t(std::max(std::thread::hardware_concurrency(), 1u));
+      ensure_workers(
+        std::min(n_workers_ + tasks_.size() - n_idle_, max_workers));
+    }
+  }
+  cv_.notify_one();
+  return future;
+}
+
+void ThreadPool::parallel_for(
+  size_t n, size_t n_chunks, std::function<void(size_t, size_t)> func)
+{
+  n_chunks = std::min(n_chunks, n);
+  if (n_chunks <= 1 || in_worker()) {
+    func(0, n);
+    return;
+  }
+  auto const& bound = [&](size_t i) { return n * i / n_chunks; };
+  auto futures = std::vector<std::future<void>>{};
+  for (auto i = size_t{1}; i < n_chunks; ++i) {
+    futures.push_back(
+      submit([&func, start = bound(i), stop = bound(i + 1)] {
+        func(start, stop);
+      }));
+  }
+  auto error = std::exception_ptr{};
+  try {
+    func(bound(0), bound(1));
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (auto& future: futures) {
+    try {
+      future.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}
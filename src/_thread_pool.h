@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+
+namespace mplcairo {
+
+// A pool of worker threads shared by all parallelized operations, which are
+// thus not limited by the number of threads that can be spawned per call.
+// Workers are started lazily.  Tasks must not touch Python objects (the GIL is
+// normally released while waiting for them).
+class ThreadPool {
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  size_t n_workers_, n_idle_;
+  long pid_;
+
+  ThreadPool();
+  void ensure_workers(size_t n);
+  void work();
+
+  public:
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  // The process-wide pool (recreated in forked children, as worker threads do
+  // not survive a fork).
+  static ThreadPool& get();
+  // Whether the current thread is a worker of some pool.
+  static bool in_worker();
+
+  std::future<void> submit(std::function<void()> task);
+  // Call func(start, stop) on n_chunks (nearly) equal subranges of [0, n).
+  // One of them is processed by the calling thread; all of them are processed
+  // serially if called from a worker (so that nested calls cannot deadlock).
+  // Exceptions are propagated (after all subranges are done).
+  void parallel_for(
+    size_t n, size_t n_chunks, std::function<void(size_t, size_t)> func);
+};
+
+}
@@ -3,4 +3,7 @@
 #include "_os.cpp"
 #include "_util.cpp"
 #include "_pattern_cache.cpp"
+#include "_pixel.cpp"
+#include "_png.cpp"
 #include "_raqm.cpp"
+#include "_thread_pool.cpp"
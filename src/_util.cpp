@@ -1,10 +1,13 @@
 #include "_util.h"
 
+#include "_os.h"
 #include "_raqm.h"
+#include "_thread_pool.h"
 
 #include FT_TRUETYPE_TABLES_H
-#include <regex>
+#include <cstring>
 #include <stack>
+#include <thread>
 
 #include "_macros.h"
 
@@ -27,12 +30,13 @@ std::unordered_map<FT_Error, std::string> const ft_errors
 #include FT_ERRORS_H
 ;
 FT_Library ft_library{};
+std::mutex ft_library_mutex{};
 bool has_pycairo{};
 std::array<uint8_t, 0x10000> premultiplication_table{[]() {
   auto table = decltype(premultiplication_table){};
   for (auto a = 1; a < 0x100; ++a) {
     for (auto c = 0; c < 0x100; ++c) {
-      table[(a << 8) + c] = a / 255. * c;
+      table[(a << 8) + c] = a * c / 0xff;  // Exact, to match SIMD kernels.
     }
   }
   return table;
@@ -53,19 +57,31 @@ ITER_CAIRO_OPTIONAL_API(DEFINE_API)
 #undef DEFINE_API
 
 // Other useful values.
-std::unordered_map<std::string, cairo_font_face_t*> FONT_CACHE{};
+FontCache FONT_CACHE{64};  // Same as font_manager._get_font's cache size.
+std::mutex FONT_CACHE_MUTEX{};
+ImageCache IMAGE_CACHE{};
+std::mutex IMAGE_CACHE_MUTEX{};
 cairo_user_data_key_t const REFS_KEY{},
                             STATE_KEY{},
                             INIT_MATRIX_KEY{},
                             FT_KEY{},
                             FEATURES_KEY{},
-                            IS_COLOR_FONT_KEY{};
+                            IS_COLOR_FONT_KEY{},
+                            EXTERNAL_IMAGES_KEY{},
+                            RASTER_RECORDING_KEY{},
+                            PIXELS_OWNER_KEY{};
 py::object RC_PARAMS{},
            PIXEL_MARKER{},
            UNIT_CIRCLE{};
 int COLLECTION_THREADS{};
+int CONVERSION_THREADS{int(std::thread::hardware_concurrency())};
+ssize_t CONVERSION_THRESHOLD{1 << 20};
 bool FLOAT_SURFACE{};
+ssize_t IMAGE_CACHE_SIZE{1 << 26};
 double MITER_LIMIT{10.};
+int PNG_THREADS{1};
+ssize_t RENDERER_POOL_SIZE{1 << 26};
+int TILE_HEIGHT{};
 bool DEBUG{};
 MplcairoScriptSurface MPLCAIRO_SCRIPT_SURFACE{[] {
   if (auto script_surface = std::getenv("MPLCAIRO_SCRIPT_SURFACE")) {
@@ -173,8 +189,11 @@ bool has_vector_surface(cairo_t* cr)
     case CAIRO_SURFACE_TYPE_PDF:
     case CAIRO_SURFACE_TYPE_PS:
     case CAIRO_SURFACE_TYPE_SVG:
-    case CAIRO_SURFACE_TYPE_RECORDING:
       return true;
+    case CAIRO_SURFACE_TYPE_RECORDING:
+      // Except for recordings made for tiled raster output.
+      return !cairo_surface_get_user_data(
+        cairo_get_target(cr), &detail::RASTER_RECORDING_KEY);
     case CAIRO_SURFACE_TYPE_SCRIPT:
       switch (detail::MPLCAIRO_SCRIPT_SURFACE) {
         case detail::MplcairoScriptSurface::Raster:
@@ -659,33 +678,282 @@ py::array image_surface_to_buffer(cairo_surface_t* surface) {
   }
 }
 
+// Call func(start, stop) on subranges of [0, n), split over
+// CONVERSION_THREADS threads if the total cost (typically, a pixel count) is
+// at least CONVERSION_THRESHOLD.  The GIL should be released by the caller.
+void maybe_parallel_for(
+  ssize_t n, ssize_t cost_per_item,
+  std::function<void(ssize_t, ssize_t)> const& func)
+{
+  auto const& n_chunks =
+    n * cost_per_item >= detail::CONVERSION_THRESHOLD
+    ? std::max(detail::CONVERSION_THREADS, 1) : 1;
+  ThreadPool::get().parallel_for(n, n_chunks, [&](size_t start, size_t stop) {
+    func(start, stop);
+  });
+}
+
+// Return a digest of the contents and shape of a (height, width, 4) image, as
+// a string.  Rows are hashed in parallel (releasing the GIL), then combined.
+// This is not a cryptographic hash, but two independent 64-bit lanes make
+// accidental collisions negligible.
+std::string image_digest(
+  py::array_t<uint8_t, py::array::c_style | py::array::forcecast> im)
+{
+  auto const& height = im.shape(0), & row_size = 4 * im.shape(1);
+  auto const& data = im.data();
+  auto const& mix = [](uint64_t h, uint64_t w, uint64_t k) {
+    h = (h ^ w) * k;
+    return h ^ (h >> 29);
+  };
+  auto const& k0 = uint64_t{0x9e3779b97f4a7c15},
+            & k1 = uint64_t{0xc2b2ae3d27d4eb4f};
+  auto rows = std::vector<std::pair<uint64_t, uint64_t>>(height);
+  {
+    auto const& nogil = py::gil_scoped_release{};
+    maybe_parallel_for(height, row_size / 4, [&](ssize_t start, ssize_t stop) {
+      for (auto i = start; i < stop; ++i) {
+        auto const& row = data + i * row_size;
+        auto h0 = uint64_t{0}, h1 = uint64_t{1};
+        auto j = ssize_t{};
+        for (; j + 8 <= row_size; j += 8) {
+          auto w = uint64_t{};
+          std::memcpy(&w, row + j, 8);
+          h0 = mix(h0, w, k0);
+          h1 = mix(h1 + w, w >> 32, k1);
+        }
+        auto w = uint64_t{};
+        std::memcpy(&w, row + j, row_size - j);
+        rows[i] = {mix(h0, w, k0), mix(h1 + w, w >> 32, k1)};
+      }
+    });
+  }
+  auto h0 = uint64_t(height), h1 = uint64_t(row_size);
+  for (auto const& [r0, r1]: rows) {
+    h0 = mix(h0, r0, k0);
+    h1 = mix(h1, r1, k1);
+  }
+  return "{}x{}-{:016x}{:016x}"_format(
+    im.shape(1), height, h0, h1).cast<std::string>();
+}
+
+namespace detail {
+
+FontCache::FontCache(size_t max_size) : max_size{max_size}
+{}
+
+cairo_font_face_t* FontCache::get(std::string const& pathspec)
+{
+  auto const& it = index_.find(pathspec);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->second;
+}
+
+void FontCache::put(std::string const& pathspec, cairo_font_face_t* font_face)
+{
+  entries_.emplace_front(pathspec, font_face);
+  index_[pathspec] = entries_.begin();
+  // Never evicts the face just added, which the caller still uses.
+  while (entries_.size() > std::max(max_size, size_t{1})) {
+    auto const& [evicted_pathspec, evicted_face] = entries_.back();
+    cairo_font_face_destroy(evicted_face);
+    index_.erase(evicted_pathspec);
+    entries_.pop_back();
+  }
+}
+
+ImageCache::ImageCache() : n_bytes_{}
+{}
+
+cairo_surface_t* ImageCache::get(std::string const& digest)
+{
+  auto const& it = index_.find(digest);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return cairo_surface_reference(it->second->second);
+}
+
+void ImageCache::put(std::string const& digest, cairo_surface_t* surface)
+{
+  if (index_.count(digest)) {  // Concurrently converted by another thread.
+    return;
+  }
+  entries_.emplace_front(digest, cairo_surface_reference(surface));
+  index_[digest] = entries_.begin();
+  n_bytes_ +=
+    cairo_image_surface_get_stride(surface)
+    * cairo_image_surface_get_height(surface);
+  trim();
+}
+
+void ImageCache::trim()
+{
+  while (entries_.size() && n_bytes_ > size_t(IMAGE_CACHE_SIZE)) {
+    auto const& [digest, surface] = entries_.back();
+    n_bytes_ -=
+      cairo_image_surface_get_stride(surface)
+      * cairo_image_surface_get_height(surface);
+    cairo_surface_destroy(surface);
+    index_.erase(digest);
+    entries_.pop_back();
+  }
+}
+
+}
+
+// Map a font file, sharing the mapping with the other faces (e.g., feature
+// variants) that use the same file.  Must be called with FONT_CACHE_MUTEX held.
+std::shared_ptr<os::MappedFile> map_font_file(std::string const& path)
+{
+  static auto mapped_files =
+    std::unordered_map<std::string, std::weak_ptr<os::MappedFile>>{};
+  if (auto const& mapped_file = mapped_files[path].lock()) {
+    return mapped_file;
+  }
+  for (auto it = mapped_files.begin(); it != mapped_files.end();) {
+    it = it->second.expired() ? mapped_files.erase(it) : std::next(it);
+  }
+  auto const& mapped_file = os::MappedFile::open(path);
+  if (mapped_file) {
+    mapped_files[path] = mapped_file;
+  }
+  return mapped_file;
+}
+
+// Split "path[#index][|features]"; the features start at the first "|", and
+// "#index" must immediately precede it (or the end of the string).
+void parse_pathspec(
+  std::string const& pathspec,
+  std::string& path, int& face_index, std::string& features_s)
+{
+  auto const& bar = pathspec.find('|');
+  path = pathspec.substr(0, bar);
+  features_s = bar != pathspec.npos ? pathspec.substr(bar + 1) : "";
+  face_index = 0;
+  auto const& hash = path.rfind('#');
+  if (hash != path.npos && hash + 1 < path.size()
+      && std::all_of(path.begin() + hash + 1, path.end(),
+                     [](char c) { return '0' <= c && c <= '9'; })) {
+    face_index = std::atoi(path.c_str() + hash + 1);
+    path.resize(hash);
+  }
+}
+
+// Parse a comma-separated feature list.  "language[start:stop]=lang" entries
+// (where the slice is optional, and either bound can be omitted) become
+// LanguageRanges; all other (nonempty) entries are OpenType feature strings.
+std::unique_ptr<std::vector<font_feature_t>> parse_features(
+  std::string const& features_s)
+{
+  auto features = std::make_unique<std::vector<font_feature_t>>();
+  auto const& parse_index = [&](std::string const& feature, size_t& pos) {
+    auto const begin = pos;
+    while (pos < feature.size()
+           && '0' <= feature[pos] && feature[pos] <= '9') {
+      ++pos;
+    }
+    return
+      pos > begin
+      ? std::optional{size_t(std::atoll(feature.c_str() + begin))}
+      : std::nullopt;
+  };
+  auto const& parse_language = [&](std::string const& feature)
+    -> std::optional<LanguageRange> {
+    auto const& prefix = std::string{"language"};
+    if (feature.compare(0, prefix.size(), prefix)) {
+      return {};
+    }
+    auto pos = prefix.size();
+    auto start = std::optional<size_t>{}, stop = std::optional<size_t>{};
+    if (pos < feature.size() && feature[pos] == '[') {
+      start = parse_index(feature, ++pos);
+      if (pos < feature.size() && feature[pos] == ':') {
+        stop = parse_index(feature, ++pos);
+      }
+      if (pos == feature.size() || feature[pos] != ']') {
+        return {};
+      }
+      ++pos;
+    }
+    if (pos == feature.size() || feature[pos] != '=') {
+      return {};
+    }
+    if (stop && *stop < start.value_or(0)) {
+      throw std::invalid_argument{
+        "invalid language range in {}"_format(feature).cast<std::string>()};
+    }
+    return LanguageRange{feature.substr(pos + 1), start.value_or(0), stop};
+  };
+  for (auto begin = size_t{}; begin <= features_s.size();) {
+    auto end = features_s.find(',', begin);
+    if (end == features_s.npos) {
+      end = features_s.size();
+    }
+    auto const& feature = features_s.substr(begin, end - begin);
+    if (feature.size()) {
+      if (auto const& language = parse_language(feature)) {
+        features->emplace_back(*language);
+      } else {
+        features->emplace_back(feature);
+      }
+    }
+    begin = end + 1;
+  }
+  return features;
+}
+
 cairo_font_face_t* font_face_from_path(std::string pathspec)
 {
-  auto& font_face = detail::FONT_CACHE[pathspec];
-  if (!font_face) {
-    auto match = std::smatch{};
-    if (!std::regex_match(pathspec, match,
-                          std::regex{"(.*?)(#(\\d+))?(\\|(.*))?"})) {
-      throw std::runtime_error{
-        "Failed to parse pathspec {}"_format(pathspec).cast<std::string>()};
+  // No Python code may run with FONT_CACHE_MUTEX held: it could hand the GIL
+  // over to another thread that would then block on the mutex while holding
+  // the GIL.  Hence, the hinting flag and the features are obtained before
+  // taking the lock, and errors needing Python are raised after releasing it.
+  {
+    auto const& lock = std::lock_guard{detail::FONT_CACHE_MUTEX};
+    if (auto const& font_face = detail::FONT_CACHE.get(pathspec)) {
+      return cairo_font_face_reference(font_face);
+    }
+  }
+  auto path = std::string{}, features_s = std::string{};
+  auto face_index = 0;
+  parse_pathspec(pathspec, path, face_index, features_s);
+  // Parsed before the face is created so that invalid specs don't leak it.
+  auto features = parse_features(features_s);
+  auto const& hinting_flag = get_hinting_flag();
+  auto const& font_face = [&]() -> cairo_font_face_t* {
+    auto const& lock = std::lock_guard{detail::FONT_CACHE_MUTEX};
+    // Another thread may have created the face in the meantime.
+    if (auto const& font_face = detail::FONT_CACHE.get(pathspec)) {
+      return cairo_font_face_reference(font_face);
     }
-    auto const& path = match.str(1);
-    auto const& face_index = std::atoi(match.str(3).c_str());  // 0 if absent.
-    auto const& features_s = match.str(5);
+    // If the file cannot be mapped, let FT_New_Face report the error.
+    auto const& mapped_file = map_font_file(path);
     FT_Face ft_face;
-    if (auto const& error =
-        FT_New_Face(detail::ft_library, path.c_str(), face_index, &ft_face)) {
+    if (auto const& error = [&] {
+          auto const& lock = std::lock_guard{detail::ft_library_mutex};
+          return
+            mapped_file
+            ? FT_New_Memory_Face(
+                detail::ft_library, mapped_file->data(), mapped_file->size(),
+                face_index, &ft_face)
+            : FT_New_Face(
+                detail::ft_library, path.c_str(), face_index, &ft_face);
+        }()) {
       if (error == FT_Err_Cannot_Open_Resource) {
-        // Throw the exception that Python would throw...
-        py::module::import("builtins").attr("open")(path);
-        if (PyErr_Occurred()) {  // ... if possible.
-          throw py::error_already_set{};
-        }
+        return nullptr;  // Reported below, without the lock.
       }
       THROW_ERROR("FT_New_Face", mplcairo::detail::ft_errors.at(error));
     }
-    font_face =
-      cairo_ft_font_face_create_for_ft_face(ft_face, get_hinting_flag());
+    // Keep the mapping alive until FT_Done_Face.
+    ft_face->generic.data =
+      mapped_file ? new std::shared_ptr<os::MappedFile>{mapped_file} : nullptr;
+    auto const& font_face =
+      cairo_ft_font_face_create_for_ft_face(ft_face, hinting_flag);
     auto font_face_cleanup =  // In case set_user_data fails; released at end.
       std::unique_ptr<
         std::remove_pointer_t<cairo_font_face_t>,
@@ -694,21 +962,22 @@ cairo_font_face_t* font_face_from_path(std::string pathspec)
     CAIRO_CHECK_SET_USER_DATA(
       cairo_font_face_set_user_data, font_face, &detail::FT_KEY, ft_face,
       [](void* ptr) -> void {
-        FT_CHECK(FT_Done_Face, reinterpret_cast<FT_Face>(ptr));
+        auto const& ft_face = reinterpret_cast<FT_Face>(ptr);
+        auto const& mapped_file =  // Released after FT_Done_Face.
+          std::unique_ptr<std::shared_ptr<os::MappedFile>>{
+            static_cast<std::shared_ptr<os::MappedFile>*>(
+              ft_face->generic.data)};
+        // May be called from any thread that drops the last reference.
+        auto const& lock = std::lock_guard{detail::ft_library_mutex};
+        FT_CHECK(FT_Done_Face, ft_face);
       });
-    auto const& comma = std::regex{","};
-    auto const& features = new std::vector<std::string>(
-      features_s.size()
-      ? std::sregex_token_iterator{
-          features_s.begin(), features_s.end(), comma, -1}
-      : std::sregex_token_iterator{},
-      std::sregex_token_iterator{});
     CAIRO_CHECK_SET_USER_DATA(
       cairo_font_face_set_user_data,
-      font_face, &detail::FEATURES_KEY, features,
+      font_face, &detail::FEATURES_KEY, features.get(),
       [](void* ptr) -> void {
-        delete static_cast<std::vector<std::string>*>(ptr);
+        delete static_cast<std::vector<font_feature_t>*>(ptr);
       });
+    features.release();
     // Color fonts need special handling due to cairo#404 and raqm#123; see
     // corresponding sections of the code.
     if (FT_IS_SFNT(ft_face)) {
@@ -732,8 +1001,20 @@ cairo_font_face_t* font_face_from_path(std::string pathspec)
       }
     }
     font_face_cleanup.release();
+    detail::FONT_CACHE.put(pathspec, font_face);
+    return cairo_font_face_reference(font_face);
+  }();
+  if (!font_face) {
+    // Throw the exception that Python would throw...
+    py::module::import("builtins").attr("open")(path);
+    if (PyErr_Occurred()) {  // ... if possible.
+      throw py::error_already_set{};
+    }
+    THROW_ERROR(
+      "FT_New_Face",
+      mplcairo::detail::ft_errors.at(FT_Err_Cannot_Open_Resource));
   }
-  return cairo_font_face_reference(font_face);
+  return font_face;
 }
 
 cairo_font_face_t* font_face_from_path(py::object path) {
@@ -802,31 +1083,30 @@ GlyphsAndClusters text_to_glyphs_and_clusters(cairo_t* cr, std::string s)
         std::remove_pointer_t<cairo_scaled_font_t>,
         decltype(&cairo_ft_scaled_font_unlock_face)>{
           scaled_font, cairo_ft_scaled_font_unlock_face};
-    auto const& rq = raqm::create();
+    auto const& rq = raqm::acquire();
     auto const& rq_cleanup =
-      std::unique_ptr<std::remove_pointer_t<raqm_t>, decltype(raqm::destroy)>{
-        rq, raqm::destroy};
+      std::unique_ptr<std::remove_pointer_t<raqm_t>, decltype(&raqm::release)>{
+        rq, raqm::release};
     if (!rq) {
       throw std::runtime_error{"failed to compute text layout"};
     }
     TRUE_CHECK(raqm::set_text_utf8, rq, s.c_str(), s.size());
     TRUE_CHECK(raqm::set_freetype_face, rq, ft_face);
     for (auto const& feature:
-         *static_cast<std::vector<std::string>*>(
+         *static_cast<std::vector<font_feature_t>*>(
            cairo_font_face_get_user_data(
              cairo_get_font_face(cr), &detail::FEATURES_KEY))) {
-      auto match = std::smatch{};
-      if (std::regex_match(
-            feature, match,
-            std::regex{"^language(?:\\[(\\d+)?(?::(\\d+))?\\])?=(.*)$"})) {
-        auto const& start = std::atoi(match.str(1).c_str());  // 0 if absent.
-        auto const& stop = match[2].matched
-                           ? std::atoi(match.str(2).c_str()) : s.size();
-        auto const& lang = match.str(3);
-        TRUE_CHECK(raqm::set_language, rq, lang.c_str(), start, stop - start);
-      } else {
-        TRUE_CHECK(raqm::add_font_feature, rq, feature.c_str(), -1);
-      }
+      std::visit(overloaded {
+        [&](std::string const& feature) {
+          TRUE_CHECK(raqm::add_font_feature, rq, feature.c_str(), -1);
+        },
+        [&](LanguageRange const& range) {
+          auto const& stop = range.stop.value_or(s.size());
+          TRUE_CHECK(
+            raqm::set_language, rq, range.language.c_str(),
+            range.start, stop - range.start);
+        }
+      }, feature);
     }
     TRUE_CHECK(raqm::layout, rq);
     auto num_glyphs = size_t{};
@@ -7,6 +7,10 @@
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
+#include <functional>
+#include <list>
+#include <mutex>
+
 // Helper for std::visit.
 template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
@@ -20,6 +24,9 @@ namespace detail {
 
 extern std::unordered_map<FT_Error, std::string> const ft_errors;
 extern FT_Library ft_library;
+// FreeType requires face creation and destruction to be serialized per library;
+// other operations on a face must be bracketed by cairo_ft_scaled_font_lock_face.
+extern std::mutex ft_library_mutex;
 extern bool has_pycairo;
 extern std::array<uint8_t, 0x10000>
   premultiplication_table, unpremultiplication_table;
@@ -32,6 +39,15 @@ extern std::array<uint8_t, 0x10000>
 extern void (*cairo_tag_begin)(cairo_t*, char const*, char const*);
 extern void (*cairo_tag_end)(cairo_t*, char const*);
 
+// Copy-pasted from cairo.h, backported from 1.12.
+#ifndef CAIRO_MIME_TYPE_UNIQUE_ID
+#define CAIRO_MIME_TYPE_UNIQUE_ID "application/x-cairo.uuid"
+#endif
+
+// Copy-pasted from cairo.h, backported from 1.14.
+extern void (*cairo_surface_get_device_scale)(
+  cairo_surface_t*, double*, double*);
+
 // Modified from cairo-pdf.h.
 enum cairo_pdf_version_t {};
 typedef enum _cairo_pdf_metadata {
@@ -75,6 +91,7 @@ extern void (*cairo_svg_surface_restrict_to_version)(
 #define ITER_CAIRO_OPTIONAL_API(_) \
   _(cairo_tag_begin) \
   _(cairo_tag_end) \
+  _(cairo_surface_get_device_scale) \
   _(cairo_pdf_get_versions) \
   _(cairo_pdf_surface_create_for_stream) \
   _(cairo_pdf_surface_restrict_to_version) \
@@ -90,21 +107,70 @@ extern void (*cairo_svg_surface_restrict_to_version)(
   _(cairo_svg_surface_create_for_stream) \
   _(cairo_svg_surface_restrict_to_version)
 
+// Maps pathspecs to font faces, holding a reference to each of them.  When
+// above max_size entries, the least recently used faces are evicted (faces
+// still referenced elsewhere stay alive, but are no longer shared by later
+// lookups).  Not synchronized; guard accesses with FONT_CACHE_MUTEX.
+class FontCache {
+  std::list<std::pair<std::string, cairo_font_face_t*>> entries_;  // MRU first.
+  std::unordered_map<std::string, decltype(entries_)::iterator> index_;
+
+  public:
+  size_t max_size;
+
+  FontCache(size_t max_size);
+  // Returns a borrowed reference, or nullptr if absent.
+  cairo_font_face_t* get(std::string const& pathspec);
+  // Steals the reference.
+  void put(std::string const& pathspec, cairo_font_face_t* font_face);
+};
+
+// Maps image digests (see image_digest) to premultiplied ARGB32 image
+// surfaces, holding a reference to each of them.  When above IMAGE_CACHE_SIZE
+// bytes of pixel data, the least recently used surfaces are evicted.  Not
+// synchronized; guard accesses with IMAGE_CACHE_MUTEX.
+class ImageCache {
+  std::list<std::pair<std::string, cairo_surface_t*>> entries_;  // MRU first.
+  std::unordered_map<std::string, decltype(entries_)::iterator> index_;
+  size_t n_bytes_;
+
+  public:
+  ImageCache();
+  // Returns a new reference, or nullptr if absent.
+  cairo_surface_t* get(std::string const& digest);
+  // Adds a reference.
+  void put(std::string const& digest, cairo_surface_t* surface);
+  // Evicts entries until within IMAGE_CACHE_SIZE.
+  void trim();
+};
+
 // Other useful values.
-extern std::unordered_map<std::string, cairo_font_face_t*> FONT_CACHE;
+extern FontCache FONT_CACHE;
+extern std::mutex FONT_CACHE_MUTEX;
+extern ImageCache IMAGE_CACHE;
+extern std::mutex IMAGE_CACHE_MUTEX;
 extern cairo_user_data_key_t const
-  REFS_KEY,           // cairo_t -> kept alive Python objects.
-  STATE_KEY,          // cairo_t -> additional state.
-  INIT_MATRIX_KEY,    // cairo_t -> cairo_matrix_t.
-  FT_KEY,             // cairo_font_face_t -> FT_Face.
-  FEATURES_KEY,       // cairo_font_face_t -> OpenType features.
-  IS_COLOR_FONT_KEY;  // cairo_font_face_t -> non-null if a color font.
+  REFS_KEY,              // cairo_t/cairo_surface_t -> kept alive objects.
+  STATE_KEY,             // cairo_t -> additional state.
+  INIT_MATRIX_KEY,       // cairo_t -> cairo_matrix_t.
+  FT_KEY,                // cairo_font_face_t -> FT_Face.
+  FEATURES_KEY,          // cairo_font_face_t -> std::vector<font_feature_t>.
+  IS_COLOR_FONT_KEY,     // cairo_font_face_t -> non-null if a color font.
+  EXTERNAL_IMAGES_KEY,   // cairo_t -> ExternalImageWriter.
+  RASTER_RECORDING_KEY,  // cairo_surface_t -> non-null if replayed to raster.
+  PIXELS_OWNER_KEY;      // cairo_surface_t -> surface owning its pixels.
 extern py::object RC_PARAMS;
 extern py::object PIXEL_MARKER;
 extern py::object UNIT_CIRCLE;
 extern int COLLECTION_THREADS;
+extern int CONVERSION_THREADS;
+extern ssize_t CONVERSION_THRESHOLD;
 extern bool FLOAT_SURFACE;
+extern ssize_t IMAGE_CACHE_SIZE;
 extern double MITER_LIMIT;
+extern int PNG_THREADS;
+extern ssize_t RENDERER_POOL_SIZE;
+extern int TILE_HEIGHT;
 extern bool DEBUG;
 enum class MplcairoScriptSurface {
   None, Raster, Vector
@@ -142,6 +208,16 @@ struct AdditionalState {
   double get_hatch_linewidth();
 };
 
+// A "language[start:stop]=lang" entry of a pathspec's feature list.  A missing
+// stop stands for the end of the string.
+struct LanguageRange {
+  std::string language;
+  size_t start;
+  std::optional<size_t> stop;
+};
+// Either an OpenType feature string or a language setting.
+using font_feature_t = std::variant<std::string, LanguageRange>;
+
 struct GlyphsAndClusters {
   cairo_glyph_t* glyphs{};
   int num_glyphs{};
@@ -172,6 +248,11 @@ void fill_and_stroke_exact(
   cairo_t* cr, py::handle path, cairo_matrix_t const* matrix,
   std::optional<rgba_t> fill, std::optional<rgba_t> stroke);
 py::array image_surface_to_buffer(cairo_surface_t* surface);
+std::string image_digest(
+  py::array_t<uint8_t, py::array::c_style | py::array::forcecast> im);
+void maybe_parallel_for(
+  ssize_t n, ssize_t cost_per_item,
+  std::function<void(ssize_t, ssize_t)> const& func);
 cairo_font_face_t* font_face_from_path(std::string path);
 cairo_font_face_t* font_face_from_path(py::object path);
 cairo_font_face_t* font_face_from_prop(py::object prop);
@@ -1,16 +1,22 @@
+from io import BytesIO
 import multiprocessing
 import sys
 
 import pytest
 
 import matplotlib as mpl
+from matplotlib import font_manager as fm
+from matplotlib.collections import LineCollection
 from matplotlib.figure import Figure
 import numpy as np
+from PIL import Image
+from PIL.PngImagePlugin import PngInfo
 
 from matplotlib.backends.backend_agg import FigureCanvasAgg
 import mplcairo
 from mplcairo import _mplcairo, antialias_t
 from mplcairo.base import FigureCanvasCairo
+from mplcairo.recording import Recording
 
 # Import an autouse fixture.
 from matplotlib.testing.conftest import mpl_test_settings
@@ -41,6 +47,40 @@ def test_cairo_to_straight_rgba8888(benchmark, buf_name):
     assert _mplcairo.cairo_to_straight_rgba8888(buf).sum() == s
 
 
+@pytest.mark.parametrize("simd", ["none", "sse4.1", "avx2", "avx512"])
+@pytest.mark.parametrize(
+    "func_name,dtype,size", [
+        ("cairo_to_straight_rgba8888", np.uint8, "4K"),
+        ("cairo_to_straight_rgba8888", np.uint8, "8K"),
+        ("cairo_to_premultiplied_rgba8888", np.uint8, "4K"),
+        ("cairo_to_premultiplied_rgba8888", np.uint8, "8K"),
+        ("cairo_to_premultiplied_argb32", np.float32, "4K"),
+    ])
+def test_cairo_to_rgba8888_large(benchmark, simd, func_name, dtype, size):
+    assert sys.byteorder == "little"
+    shape = {"4K": (2160, 3840, 4), "8K": (4320, 7680, 4)}[size]
+    rs = np.random.RandomState(0)
+    if dtype == np.uint8:
+        buf = rs.randint(0x100, size=shape, dtype=np.uint8)
+        buf[..., :3] = buf[..., :3] * (buf[..., 3:] / 0xff)
+    else:
+        buf = rs.random_sample(shape).astype(np.float32)
+        buf[..., :3] *= buf[..., 3:]
+    func = getattr(_mplcairo, func_name)
+    prev_simd = mplcairo.get_options()["_simd"]
+    try:
+        mplcairo.set_options(_simd="none")
+        expected = func(buf)
+        try:
+            mplcairo.set_options(_simd=simd)
+        except ValueError:
+            pytest.skip(f"{simd} is not supported by this CPU")
+        benchmark(func, buf)
+        np.testing.assert_array_equal(func(buf), expected)
+    finally:
+        mplcairo.set_options(_simd=prev_simd)
+
+
 @pytest.fixture
 def axes():
     mpl.rcdefaults()
@@ -168,3 +208,285 @@ def test_image(benchmark, canvas_cls, axes, sample_image):
     despine(axes)
     axes.figure.canvas = canvas_cls(axes.figure)
     benchmark(axes.figure.canvas.draw)
+
+
+@pytest.mark.parametrize("raqm", [False, True])
+@pytest.mark.parametrize("features", ["", "|dlig,language=en"])
+def test_text(benchmark, axes, raqm, features):
+    try:
+        mplcairo.set_options(raqm=raqm)
+    except OSError:
+        pytest.skip("raqm is not available")
+    try:
+        prop = fm.FontProperties(fname=fm.findfont("DejaVu Sans") + features)
+        for i in range(100):
+            axes.text(
+                i / 100, i / 100, "style {}".format(i), fontproperties=prop)
+        despine(axes)
+        axes.figure.canvas = FigureCanvasCairo(axes.figure)
+        benchmark(axes.figure.canvas.draw)
+    finally:
+        mplcairo.set_options(raqm=False)
+
+
+@pytest.mark.parametrize(
+    "pil_kwargs", [
+        {},  # Native writer, adaptive filtering.
+        {"compress_level": 1, "filter": "none"},  # Native writer, fast.
+        {"threads": multiprocessing.cpu_count()},  # Parallel deflate.
+        {"pnginfo": PngInfo()},  # Goes through Pillow.
+    ],
+    ids=["native", "native-fast", "native-threads", "pil"])
+def test_print_png(benchmark, axes, sample_image, pil_kwargs):
+    axes.imshow(sample_image)
+    axes.figure.set_dpi(300)
+    canvas = axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    benchmark(lambda: canvas.print_png(BytesIO(), pil_kwargs=pil_kwargs))
+    # Throughput, in megapixels per second.
+    benchmark.extra_info["Mpx/s"] = (
+        canvas.buffer_rgba().size / 4 / 1e6 / benchmark.stats.stats.mean)
+    stream = BytesIO()
+    canvas.print_png(stream, pil_kwargs=pil_kwargs)
+    stream.seek(0)
+    np.testing.assert_array_equal(
+        np.asarray(Image.open(stream)), canvas.buffer_rgba())
+
+
+@pytest.mark.parametrize("tile_height", [64, 512])
+def test_print_png_tiled(benchmark, axes, sample_image, tile_height):
+    axes.imshow(sample_image)
+    axes.figure.set_dpi(300)
+    canvas = axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    mplcairo.set_options(tile_height=tile_height)
+    try:
+        benchmark(lambda: canvas.print_png(BytesIO()))
+        stream = BytesIO()
+        canvas.print_png(stream)
+    finally:
+        mplcairo.set_options(tile_height=0)
+    stream.seek(0)
+    canvas.draw()  # Tiled output doesn't draw the canvas' own renderer.
+    # Replaying may round slightly differently than drawing directly.
+    np.testing.assert_allclose(
+        np.asarray(Image.open(stream)).astype(int),
+        canvas.buffer_rgba().astype(int), atol=1)
+
+
+@pytest.mark.parametrize("recording", [False, True])
+def test_savefig_formats(benchmark, axes, sample_vectors, recording):
+    axes.plot(*sample_vectors)
+    axes.figure.canvas = FigureCanvasCairo(axes.figure)
+
+    def savefig_formats():
+        savefig = (Recording(axes.figure).savefig if recording
+                   else axes.figure.savefig)
+        for fmt in ["pdf", "svg", "png"]:
+            savefig(BytesIO(), format=fmt)
+
+    benchmark(savefig_formats)
+
+
+@pytest.mark.parametrize("target_buffer", [False, True])
+def test_draw_to_target_buffer(
+        benchmark, axes, sample_vectors, target_buffer):
+    axes.plot(*sample_vectors)
+    canvas = axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    width, height = canvas.get_width_height()
+    buf = np.zeros((height, width, 4), np.uint8)
+    if target_buffer:
+        canvas.set_target_buffer(buf)
+        benchmark(canvas.draw)
+    else:  # Draw, then copy out.
+        def draw_and_copy():
+            canvas.draw()
+            np.copyto(buf, canvas.get_renderer()._get_buffer())
+
+        benchmark(draw_and_copy)
+    np.testing.assert_array_equal(buf, canvas.get_renderer()._get_buffer())
+
+
+@pytest.mark.parametrize("pool_size", [0, 2**26])
+def test_renderer_pool(benchmark, pool_size):
+    # Many short-lived figures, alternating between two sizes.
+    prev_pool_size = mplcairo.get_options()["renderer_pool_size"]
+
+    def draw_figures():
+        for figsize in [(2, 2), (8, 6)] * 10:
+            fig = Figure(figsize=figsize)
+            FigureCanvasCairo(fig).draw()
+
+    try:
+        mplcairo.set_options(renderer_pool_size=pool_size)
+        benchmark(draw_figures)
+    finally:
+        mplcairo.set_options(renderer_pool_size=prev_pool_size)
+
+
+def test_renderer_pool_held_renderer():
+    # A renderer still held (e.g., for blitting) must not be handed out again
+    # after its canvas switches to another renderer.
+    prev_pool_size = mplcairo.get_options()["renderer_pool_size"]
+    try:
+        mplcairo.set_options(renderer_pool_size=2**26)
+        fig = Figure(figsize=(2, 2))
+        canvas = FigureCanvasCairo(fig)
+        canvas.draw()
+        renderer = canvas.get_renderer()
+        expected = renderer._get_buffer().copy()
+        fig.set_size_inches(3, 3)
+        canvas.draw()
+        other_fig = Figure(figsize=(2, 2), facecolor="r")
+        other_canvas = FigureCanvasCairo(other_fig)
+        other_canvas.draw()
+        assert other_canvas.get_renderer() is not renderer
+        np.testing.assert_array_equal(renderer._get_buffer(), expected)
+    finally:
+        mplcairo.set_options(renderer_pool_size=prev_pool_size)
+
+
+def test_savefig_rasterized_pdf(benchmark, axes, sample_vectors):
+    # Many small rasterized artists on a large figure.
+    axes.figure.set_size_inches(20, 20)
+    for i in range(20):
+        axes.plot(*sample_vectors[:, :100] / 10 + i / 20, rasterized=True)
+    axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    benchmark(axes.figure.savefig, BytesIO(), format="pdf")
+
+
+@pytest.mark.parametrize("image_cache_size", [0, 2**26])
+def test_image_redraw(benchmark, axes, image_cache_size):
+    # An unchanging, partially transparent image, redrawn as in animations.
+    axes.imshow(np.random.RandomState(0).random_sample((1000, 1000)),
+                alpha=.5, interpolation="none")
+    despine(axes)
+    canvas = axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    prev_size = mplcairo.get_options()["image_cache_size"]
+    try:
+        mplcairo.set_options(image_cache_size=image_cache_size)
+        benchmark(canvas.draw)
+    finally:
+        mplcairo.set_options(image_cache_size=prev_size)
+
+
+def test_savefig_repeated_image(benchmark, sample_image):
+    # The same image on every axes (e.g. a logo), embedded only once.
+    fig = Figure()
+    for ax in fig.subplots(4, 4).flat:
+        ax.imshow(sample_image, interpolation="none")
+        despine(ax)
+    fig.canvas = FigureCanvasCairo(fig)
+    benchmark(fig.savefig, BytesIO(), format="pdf")
+
+
+def test_savefig_svg_external_images(benchmark, tmp_path):
+    fig = Figure()
+    for ax in fig.subplots(8, 8).flat:
+        ax.imshow(np.random.RandomState(0).random_sample((100, 100)))
+        despine(ax)
+    fig.canvas = FigureCanvasCairo(fig)
+    with mpl.rc_context({"svg.image_inline": False}):
+        benchmark(fig.savefig, tmp_path / "test.svg")
+
+
+@pytest.mark.parametrize("canvas_cls", _canvas_classes)
+def test_pcolormesh_rectilinear(benchmark, canvas_cls, axes):
+    # Non-uniform, but rectilinear, cell boundaries.
+    x = np.cumsum(np.random.RandomState(0).random_sample(1001))
+    y = np.cumsum(np.random.RandomState(1).random_sample(1001))
+    axes.pcolormesh(
+        x, y, np.random.RandomState(2).random_sample((1000, 1000)))
+    despine(axes)
+    axes.figure.canvas = canvas_cls(axes.figure)
+    benchmark(axes.figure.canvas.draw)
+
+
+@pytest.mark.parametrize(
+    "collection_threads", [0, multiprocessing.cpu_count() - 1])
+def test_pcolormesh_edges(benchmark, axes, collection_threads):
+    # A curvilinear grid, filled quad by quad, with uniform edges.
+    x, y = np.meshgrid(np.arange(301), np.arange(301))
+    axes.pcolormesh(
+        x + .2 * y, y, np.random.RandomState(0).random_sample((300, 300)),
+        edgecolors="k", linewidth=.1)
+    despine(axes)
+    axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    mplcairo.set_options(collection_threads=collection_threads)
+    try:
+        benchmark(axes.figure.canvas.draw)
+    finally:
+        mplcairo.set_options(collection_threads=0)
+
+
+@pytest.mark.parametrize("dtype", [np.float32, np.float64])
+def test_pcolormesh_curvilinear(benchmark, axes, dtype):
+    # Not rectilinear, so drawn with a mesh pattern.
+    x, y = np.meshgrid(*2 * [np.arange(501, dtype=dtype)])
+    axes.pcolormesh(
+        x + .2 * y, y, np.random.RandomState(0).random_sample((500, 500)))
+    despine(axes)
+    axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    benchmark(axes.figure.canvas.draw)
+
+
+def test_tripcolor_gouraud(benchmark, axes):
+    rs = np.random.RandomState(0)
+    x, y = rs.random_sample((2, 100_000))
+    axes.tripcolor(x, y, np.hypot(x - .5, y - .5), shading="gouraud")
+    despine(axes)
+    axes.figure.canvas = FigureCanvasCairo(axes.figure)
+    benchmark(axes.figure.canvas.draw)
+
+
+def test_tripcolor_gouraud_matches_mesh_pattern():
+    # The native rasterizer (used on raster outputs) vs. cairo's mesh patterns
+    # (used when recording, here replayed to a raster output).
+    fig = Figure(figsize=(4, 4))
+    ax = fig.add_axes([0, 0, 1, 1])
+    ax.set_axis_off()
+    x, y = np.meshgrid(*2 * [np.linspace(0, 1, 41)])
+    x, y = x.ravel(), y.ravel()
+    ax.tripcolor(x, y, np.hypot(x - .5, y - .5), shading="gouraud")
+    ax.set(xlim=(0, 1), ylim=(0, 1))
+    fig.canvas = FigureCanvasCairo(fig)
+    native, recorded = BytesIO(), BytesIO()
+    fig.savefig(native, format="png")
+    Recording(fig).savefig(recorded, format="png")
+    native_img, recorded_img = [
+        np.asarray(Image.open(BytesIO(buf.getvalue())), float)
+        for buf in [native, recorded]]
+    np.testing.assert_allclose(native_img, recorded_img, atol=4)
+
+
+@pytest.mark.parametrize("canvas_cls", _canvas_classes)
+def test_line_collection(benchmark, canvas_cls, axes):
+    # Many short, uniformly styled segments.
+    segments = np.random.RandomState(0).random_sample((100_000, 2, 2))
+    axes.add_collection(LineCollection(segments, colors="k", linewidths=.5))
+    despine(axes)
+    axes.figure.canvas = canvas_cls(axes.figure)
+    benchmark(axes.figure.canvas.draw)
+
+
+def test_line_collection_merged_strokes():
+    def render(segments, **kwargs):
+        fig = Figure(figsize=(4, 4))
+        ax = fig.add_axes([0, 0, 1, 1])
+        ax.set_axis_off()
+        ax.set(xlim=(0, 1), ylim=(0, 1))
+        ax.add_collection(LineCollection(segments, **kwargs))
+        canvas = FigureCanvasCairo(fig)
+        canvas.draw()
+        return np.asarray(canvas.buffer_rgba(), float)  # Copies the scratch.
+
+    # Uniform opaque items are stroked merged; linewidths differing by epsilon
+    # force stroking item by item.
+    segments = [[(.1, y), (.9, y)] for y in np.linspace(.05, .95, 30)]
+    np.testing.assert_allclose(
+        render(segments, colors="k", linewidths=.5),
+        render(segments, colors="k", linewidths=[.5, .5 + 1e-9]),
+        atol=2)
+    # Translucent items are still composited one by one: two overlapping
+    # layers of 50% black over white, not a single one.
+    img = render([[(0, .5), (1, .5)]] * 2, colors=[(0, 0, 0, .5)],
+                 linewidths=10)
+    assert img[200, 200, 0] < 100